@@ -16,7 +16,7 @@ namespace carl {
 class AstNodeVisitor;
 class Variable;
 
-enum class AstNodeType { Statement, Block, Expression, Type, FormalParam, FnDecl, LetDecl, AdtStmt, ExprStmt, ReturnStmt, WhileStmt, Assignment, Binary, Unary, Variable, Literal, String, Number, Call, MatchArm, Match };
+enum class AstNodeType { Statement, Block, Expression, Type, FormalParam, FnDecl, LetDecl, AdtStmt, ExprStmt, ReturnStmt, WhileStmt, Assignment, Binary, Unary, Variable, Literal, String, Number, Call, Placeholder, ArrayLiteral, ArrayRepeat, Index, MatchArm, Match };
 
 class AstNode {
    public:
@@ -39,6 +39,7 @@ class Block : public Statement {
     AstNodeType get_node_type() const;
     Block(std::list<std::shared_ptr<AstNode>> declarations) : declarations(declarations) {}
     const std::list<std::shared_ptr<AstNode>>& get_declarations() const { return this->declarations; }
+    void set_declarations(std::list<std::shared_ptr<AstNode>> declarations) { this->declarations = declarations;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -62,6 +63,7 @@ class Type : public AstNode {
     AstNodeType get_node_type() const;
     Type(Token name) : name(name) {}
     const Token& get_name() const { return this->name; }
+    void set_name(Token name) { this->name = name;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -76,6 +78,7 @@ class FormalParam : public AstNode {
     }
     const Token& get_name() const { return this->name; }
     std::shared_ptr<types::Type> get_type() const { return this->type; }
+    void set_name(Token name) { this->name = name;}
     void set_type(std::shared_ptr<types::Type> type) { this->type = type;}
     void accept(AstNodeVisitor* visitor);
 };
@@ -89,6 +92,7 @@ class FnDecl : public AstNode {
     std::shared_ptr<types::Type> type;
     std::list<std::shared_ptr<Variable>> captures;
     bool is_extern;
+    bool escapes;
    public:
     AstNodeType get_node_type() const;
     FnDecl(Token name, std::list<std::shared_ptr<FormalParam>> formals, std::shared_ptr<Block> body) : name(name), formals(formals), body(body) {
@@ -96,6 +100,7 @@ class FnDecl : public AstNode {
         this->type = std::make_shared<types::Unknown>();
         this->captures = std::list<std::shared_ptr<Variable>>();
         this->is_extern = false;
+        this->escapes = true;
     }
     const Token& get_name() const { return this->name; }
     const std::string& get_sname() const { return this->sname; }
@@ -104,10 +109,15 @@ class FnDecl : public AstNode {
     std::shared_ptr<types::Type> get_type() const { return this->type; }
     const std::list<std::shared_ptr<Variable>>& get_captures() const { return this->captures; }
     const bool& get_is_extern() const { return this->is_extern; }
+    const bool& get_escapes() const { return this->escapes; }
+    void set_name(Token name) { this->name = name;}
     void set_sname(std::string sname) { this->sname = sname;}
+    void set_formals(std::list<std::shared_ptr<FormalParam>> formals) { this->formals = formals;}
+    void set_body(std::shared_ptr<Block> body) { this->body = body;}
     void set_type(std::shared_ptr<types::Type> type) { this->type = type;}
     void set_captures(std::list<std::shared_ptr<Variable>> captures) { this->captures = captures;}
     void set_is_extern(bool is_extern) { this->is_extern = is_extern;}
+    void set_escapes(bool escapes) { this->escapes = escapes;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -124,6 +134,8 @@ class LetDecl : public AstNode {
     const Token& get_name() const { return this->name; }
     std::shared_ptr<Expression> get_initializer() const { return this->initializer; }
     std::shared_ptr<types::Type> get_type() const { return this->type; }
+    void set_name(Token name) { this->name = name;}
+    void set_initializer(std::shared_ptr<Expression> initializer) { this->initializer = initializer;}
     void set_type(std::shared_ptr<types::Type> type) { this->type = type;}
     void accept(AstNodeVisitor* visitor);
 };
@@ -135,6 +147,7 @@ class AdtStmt : public Statement {
     AstNodeType get_node_type() const;
     AdtStmt(std::shared_ptr<types::Type> type) : type(type) {}
     std::shared_ptr<types::Type> get_type() const { return this->type; }
+    void set_type(std::shared_ptr<types::Type> type) { this->type = type;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -145,6 +158,7 @@ class ExprStmt : public Statement {
     AstNodeType get_node_type() const;
     ExprStmt(std::shared_ptr<Expression> expr) : expr(expr) {}
     std::shared_ptr<Expression> get_expr() const { return this->expr; }
+    void set_expr(std::shared_ptr<Expression> expr) { this->expr = expr;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -155,6 +169,7 @@ class ReturnStmt : public Statement {
     AstNodeType get_node_type() const;
     ReturnStmt(std::shared_ptr<Expression> expr) : expr(expr) {}
     std::shared_ptr<Expression> get_expr() const { return this->expr; }
+    void set_expr(std::shared_ptr<Expression> expr) { this->expr = expr;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -167,6 +182,8 @@ class WhileStmt : public Statement {
     WhileStmt(std::shared_ptr<Expression> condition, std::shared_ptr<Statement> body) : condition(condition), body(body) {}
     std::shared_ptr<Expression> get_condition() const { return this->condition; }
     std::shared_ptr<Statement> get_body() const { return this->body; }
+    void set_condition(std::shared_ptr<Expression> condition) { this->condition = condition;}
+    void set_body(std::shared_ptr<Statement> body) { this->body = body;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -179,6 +196,8 @@ class Assignment : public Expression {
     Assignment(std::shared_ptr<Expression> target, std::shared_ptr<Expression> expr) : target(target), expr(expr) {}
     std::shared_ptr<Expression> get_target() const { return this->target; }
     std::shared_ptr<Expression> get_expr() const { return this->expr; }
+    void set_target(std::shared_ptr<Expression> target) { this->target = target;}
+    void set_expr(std::shared_ptr<Expression> expr) { this->expr = expr;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -193,6 +212,9 @@ class Binary : public Expression {
     const Token& get_op() const { return this->op; }
     std::shared_ptr<Expression> get_lhs() const { return this->lhs; }
     std::shared_ptr<Expression> get_rhs() const { return this->rhs; }
+    void set_op(Token op) { this->op = op;}
+    void set_lhs(std::shared_ptr<Expression> lhs) { this->lhs = lhs;}
+    void set_rhs(std::shared_ptr<Expression> rhs) { this->rhs = rhs;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -205,6 +227,8 @@ class Unary : public Expression {
     Unary(Token op, std::shared_ptr<Expression> operand) : op(op), operand(operand) {}
     const Token& get_op() const { return this->op; }
     std::shared_ptr<Expression> get_operand() const { return this->operand; }
+    void set_op(Token op) { this->op = op;}
+    void set_operand(std::shared_ptr<Expression> operand) { this->operand = operand;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -215,6 +239,7 @@ class Variable : public Expression {
     AstNodeType get_node_type() const;
     Variable(Token name) : name(name) {}
     const Token& get_name() const { return this->name; }
+    void set_name(Token name) { this->name = name;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -225,6 +250,7 @@ class Literal : public Expression {
     AstNodeType get_node_type() const;
     Literal(Token value) : value(value) {}
     const Token& get_value() const { return this->value; }
+    void set_value(Token value) { this->value = value;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -235,6 +261,7 @@ class String : public Expression {
     AstNodeType get_node_type() const;
     String(Token value) : value(value) {}
     const Token& get_value() const { return this->value; }
+    void set_value(Token value) { this->value = value;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -245,6 +272,7 @@ class Number : public Expression {
     AstNodeType get_node_type() const;
     Number(Token value) : value(value) {}
     const Token& get_value() const { return this->value; }
+    void set_value(Token value) { this->value = value;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -252,11 +280,77 @@ class Call : public Expression {
    private:
     Token fname;
     std::list<std::shared_ptr<Expression>> arguments;
+    bool is_partial;
    public:
     AstNodeType get_node_type() const;
-    Call(Token fname, std::list<std::shared_ptr<Expression>> arguments) : fname(fname), arguments(arguments) {}
+    Call(Token fname, std::list<std::shared_ptr<Expression>> arguments) : fname(fname), arguments(arguments) {
+        this->is_partial = false;
+    }
     const Token& get_fname() const { return this->fname; }
     const std::list<std::shared_ptr<Expression>>& get_arguments() const { return this->arguments; }
+    const bool& get_is_partial() const { return this->is_partial; }
+    void set_fname(Token fname) { this->fname = fname;}
+    void set_arguments(std::list<std::shared_ptr<Expression>> arguments) { this->arguments = arguments;}
+    void set_is_partial(bool is_partial) { this->is_partial = is_partial;}
+    void accept(AstNodeVisitor* visitor);
+};
+
+class Placeholder : public Expression {
+   private:
+    Token token;
+   public:
+    AstNodeType get_node_type() const;
+    Placeholder(Token token) : token(token) {}
+    const Token& get_token() const { return this->token; }
+    void set_token(Token token) { this->token = token;}
+    void accept(AstNodeVisitor* visitor);
+};
+
+class ArrayLiteral : public Expression {
+   private:
+    Token bracket;
+    std::list<std::shared_ptr<Expression>> elements;
+   public:
+    AstNodeType get_node_type() const;
+    ArrayLiteral(Token bracket, std::list<std::shared_ptr<Expression>> elements) : bracket(bracket), elements(elements) {}
+    const Token& get_bracket() const { return this->bracket; }
+    const std::list<std::shared_ptr<Expression>>& get_elements() const { return this->elements; }
+    void set_bracket(Token bracket) { this->bracket = bracket;}
+    void set_elements(std::list<std::shared_ptr<Expression>> elements) { this->elements = elements;}
+    void accept(AstNodeVisitor* visitor);
+};
+
+class ArrayRepeat : public Expression {
+   private:
+    Token bracket;
+    std::shared_ptr<Expression> value;
+    std::shared_ptr<Expression> count;
+   public:
+    AstNodeType get_node_type() const;
+    ArrayRepeat(Token bracket, std::shared_ptr<Expression> value, std::shared_ptr<Expression> count) : bracket(bracket), value(value), count(count) {}
+    const Token& get_bracket() const { return this->bracket; }
+    std::shared_ptr<Expression> get_value() const { return this->value; }
+    std::shared_ptr<Expression> get_count() const { return this->count; }
+    void set_bracket(Token bracket) { this->bracket = bracket;}
+    void set_value(std::shared_ptr<Expression> value) { this->value = value;}
+    void set_count(std::shared_ptr<Expression> count) { this->count = count;}
+    void accept(AstNodeVisitor* visitor);
+};
+
+class Index : public Expression {
+   private:
+    Token bracket;
+    std::shared_ptr<Expression> array;
+    std::shared_ptr<Expression> index;
+   public:
+    AstNodeType get_node_type() const;
+    Index(Token bracket, std::shared_ptr<Expression> array, std::shared_ptr<Expression> index) : bracket(bracket), array(array), index(index) {}
+    const Token& get_bracket() const { return this->bracket; }
+    std::shared_ptr<Expression> get_array() const { return this->array; }
+    std::shared_ptr<Expression> get_index() const { return this->index; }
+    void set_bracket(Token bracket) { this->bracket = bracket;}
+    void set_array(std::shared_ptr<Expression> array) { this->array = array;}
+    void set_index(std::shared_ptr<Expression> index) { this->index = index;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -267,6 +361,7 @@ class MatchArm : public Expression {
     AstNodeType get_node_type() const;
     MatchArm(std::shared_ptr<Expression> result) : result(result) {}
     std::shared_ptr<Expression> get_result() const { return this->result; }
+    void set_result(std::shared_ptr<Expression> result) { this->result = result;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -279,6 +374,8 @@ class Match : public Expression {
     Match(std::shared_ptr<Expression> matchee, std::list<std::shared_ptr<MatchArm>> arms) : matchee(matchee), arms(arms) {}
     std::shared_ptr<Expression> get_matchee() const { return this->matchee; }
     const std::list<std::shared_ptr<MatchArm>>& get_arms() const { return this->arms; }
+    void set_matchee(std::shared_ptr<Expression> matchee) { this->matchee = matchee;}
+    void set_arms(std::list<std::shared_ptr<MatchArm>> arms) { this->arms = arms;}
     void accept(AstNodeVisitor* visitor);
 };
 
@@ -303,6 +400,10 @@ class AstNodeVisitor {
     virtual void visit_string(String* string) { assert(false && "visit string not overwritten"); };
     virtual void visit_number(Number* number) { assert(false && "visit number not overwritten"); };
     virtual void visit_call(Call* call) { assert(false && "visit call not overwritten"); };
+    virtual void visit_placeholder(Placeholder* placeholder) { assert(false && "visit placeholder not overwritten"); };
+    virtual void visit_arrayliteral(ArrayLiteral* arrayliteral) { assert(false && "visit arrayliteral not overwritten"); };
+    virtual void visit_arrayrepeat(ArrayRepeat* arrayrepeat) { assert(false && "visit arrayrepeat not overwritten"); };
+    virtual void visit_index(Index* index) { assert(false && "visit index not overwritten"); };
     virtual void visit_matcharm(MatchArm* matcharm) { assert(false && "visit matcharm not overwritten"); };
     virtual void visit_match(Match* match) { assert(false && "visit match not overwritten"); };
 };
@@ -32,6 +32,10 @@ class AstPrinter : public AstNodeVisitor {
     void visit_string(String* string);
     void visit_number(Number* number);
     void visit_call(Call* call);
+    void visit_placeholder(Placeholder* placeholder);
+    void visit_arrayliteral(ArrayLiteral* arrayliteral);
+    void visit_arrayrepeat(ArrayRepeat* arrayrepeat);
+    void visit_index(Index* index);
     void visit_matcharm(MatchArm* matcharm);
     void visit_match(Match* match);
 private:
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "carl/ast/ast.h"
+#include "carl/name_environment.h"
+
+namespace carl {
+
+/*
+Simplifies the typed ast before code generation.
+
+- arithmetic and comparisons of number literals, ! and unary - of literals
+- string literals that are concatenated (also inside longer chains)
+- lets that bind a literal and are never assigned are replaced by the literal
+- while loops whose condition is false are dropped
+- calls of a let bound composition of fn declarations (let h = f . g;
+  h(x)) become nested direct calls (f(g(x)))
+
+Folding follows the runtime semantics: int arithmetic wraps, division by zero
+is left to the runtime, float results that are not finite are not folded.
+*/
+class ConstantFolding : public AstNodeVisitor {
+   private:
+    struct Binding {
+        /* Literal the name is bound to for good. */
+        std::shared_ptr<Expression> constant;
+        /* fn declaration the name refers to. */
+        FnDecl* fndecl = nullptr;
+        /* let h = f . g binds f and g, applied last to first. */
+        std::vector<FnDecl*> composition;
+        /* Nesting depth of the function the name is bound in. */
+        int fn_depth = 0;
+    };
+
+    std::unique_ptr<Environment<Binding>> env;
+    /* Names that are the target of an assignment anywhere in the program. */
+    std::set<std::string> assigned;
+    int fn_depth = 0;
+    bool incremental = false;
+    /* Replacement of the visited expression. */
+    std::shared_ptr<Expression> result;
+    uint64_t num_folded = 0;
+
+    void do_visit(const std::shared_ptr<AstNode>& node) { node->accept(this); }
+
+   public:
+    ConstantFolding();
+    void run(std::vector<std::shared_ptr<AstNode>>& decls);
+    /* The declarations are one line of a session (Codegen2::set_incremental()),
+     * later lines may assign to its top level lets, so they are never
+     * replaced by their value. */
+    void set_incremental(bool enabled) { incremental = enabled; }
+    /* Expressions that were replaced. */
+    uint64_t get_num_folded() const { return num_folded; }
+
+    void visit_type(Type* type);
+    void visit_formalparam(FormalParam* formalparam);
+    void visit_fndecl(FnDecl* fndecl);
+    void visit_letdecl(LetDecl* letdecl);
+    void visit_adtstmt(AdtStmt* adtstmt);
+    void visit_exprstmt(ExprStmt* exprstmt);
+    void visit_returnstmt(ReturnStmt* returnstmt);
+    void visit_whilestmt(WhileStmt* whilestmt);
+    void visit_block(Block* block);
+    void visit_assignment(Assignment* assignment);
+    void visit_binary(Binary* binary);
+    void visit_unary(Unary* unary);
+    void visit_variable(Variable* variable);
+    void visit_literal(Literal* literal);
+    void visit_string(String* string);
+    void visit_number(Number* number);
+    void visit_call(Call* call);
+    void visit_placeholder(Placeholder* placeholder);
+    void visit_arrayliteral(ArrayLiteral* arrayliteral);
+    void visit_arrayrepeat(ArrayRepeat* arrayrepeat);
+    void visit_index(Index* index);
+    void visit_matcharm(MatchArm* matcharm);
+    void visit_match(Match* match);
+
+   private:
+    std::shared_ptr<Expression> fold(const std::shared_ptr<Expression>& expr);
+    /* Folds the statements, drops the ones that can never run. */
+    template <typename Container>
+    void fold_declarations(Container& decls);
+    std::shared_ptr<Expression> concat_strings(Binary* binary);
+    std::shared_ptr<Expression> apply_composition(Call* call);
+};
+
+}  // namespace carl
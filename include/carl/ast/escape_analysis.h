@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "carl/ast/ast.h"
+#include "carl/name_environment.h"
+
+namespace carl {
+
+/*
+Finds fn declarations whose crt_fn never leaves the scope it is declared in.
+
+A closure escapes as soon as its name is used as a value (returned, passed as
+argument, bound with let, composed, partially applied, ...), calling it does
+not. FnDecl::escapes is cleared for all others, codegen can then keep their
+crt_fn and captures on the stack of the enclosing function.
+*/
+class EscapeAnalysis : public AstNodeVisitor {
+   private:
+    /* fn declarations by name, nullptr for names that shadow them (lets and
+     * formal parameters). */
+    std::unique_ptr<Environment<FnDecl*>> env;
+
+    void do_visit(const std::shared_ptr<AstNode>& node) { node->accept(this); }
+
+   public:
+    EscapeAnalysis();
+    void run(const std::vector<std::shared_ptr<AstNode>>& decls);
+    void visit_type(Type* type);
+    void visit_formalparam(FormalParam* formalparam);
+    void visit_fndecl(FnDecl* fndecl);
+    void visit_letdecl(LetDecl* letdecl);
+    void visit_adtstmt(AdtStmt* adtstmt);
+    void visit_exprstmt(ExprStmt* exprstmt);
+    void visit_returnstmt(ReturnStmt* returnstmt);
+    void visit_whilestmt(WhileStmt* whilestmt);
+    void visit_block(Block* block);
+    void visit_assignment(Assignment* assignment);
+    void visit_binary(Binary* binary);
+    void visit_unary(Unary* unary);
+    void visit_variable(Variable* variable);
+    void visit_literal(Literal* literal);
+    void visit_string(String* string);
+    void visit_number(Number* number);
+    void visit_call(Call* call);
+    void visit_placeholder(Placeholder* placeholder);
+    void visit_arrayliteral(ArrayLiteral* arrayliteral);
+    void visit_arrayrepeat(ArrayRepeat* arrayrepeat);
+    void visit_index(Index* index);
+    void visit_matcharm(MatchArm* matcharm);
+    void visit_match(Match* match);
+};
+
+}  // namespace carl
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace carl {
+
+/* Functions the compiler implements itself because no carl signature fits
+ * them, e.g. len works on arrays of every element type. Names bound in the
+ * program shadow them.
+ *
+ * map(f, a), filter(p, a) and fold(f, init, a) take the array last, nested
+ * calls are fused into one loop.
+ *
+ * par_map(f, a) and par_reduce(f, init, a) split the array across the
+ * threads of the runtime's pool. f has to be pure, for par_reduce it has to be
+ * associative with init as its identity (every thread starts from init). */
+enum class Intrinsic { NONE, LEN, MAP, FILTER, FOLD, PAR_MAP, PAR_REDUCE };
+
+Intrinsic intrinsic_from_name(const std::string& name);
+
+}  // namespace carl
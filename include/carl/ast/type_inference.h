@@ -6,6 +6,7 @@
 #include <optional>
 
 #include "carl/ast/ast.h"
+#include "carl/ast/intrinsics.h"
 #include "carl/name_environment.h"
 
 namespace carl {
@@ -45,10 +46,14 @@ class TypeInference : public AstNodeVisitor {
 
     void clear_error() { error = std::nullopt; }
 
+    void intrinsic_call(Call* call, Intrinsic intrinsic);
+
    public:
     TypeInference();
     TypeInferenceResult run(std::shared_ptr<AstNode> decl);
     TypeInferenceResult run(std::vector<std::shared_ptr<AstNode>> decls);
+    /* Drops the type of a top level let or fn of an earlier run(). */
+    void forget(const std::string& name);
     void visit_type(Type* type);
     void visit_formalparam(FormalParam* formalparam);
     void visit_fndecl(FnDecl* fndecl);
@@ -65,5 +70,9 @@ class TypeInference : public AstNodeVisitor {
     void visit_string(String* string);
     void visit_number(Number* number);
     void visit_call(Call* call);
+    void visit_placeholder(Placeholder* placeholder);
+    void visit_arrayliteral(ArrayLiteral* arrayliteral);
+    void visit_arrayrepeat(ArrayRepeat* arrayrepeat);
+    void visit_index(Index* index);
 };
 }  // namespace carl
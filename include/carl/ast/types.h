@@ -10,7 +10,7 @@
 namespace carl {
 namespace types {
 
-enum class BaseType { UNKNOWN, BOOL, STRING, INT, FLOAT, VOID, FN, ADT };
+enum class BaseType { UNKNOWN, BOOL, STRING, INT, FLOAT, VOID, FN, ARRAY, ADT };
 
 class Type {
    public:
@@ -91,6 +91,22 @@ class Fn : public Type {
     std::string str() const;
 };
 
+/* [T], a contiguous sequence of elements of type T. */
+class Array : public Type {
+   private:
+    std::shared_ptr<Type> element;
+
+   public:
+    Array(std::shared_ptr<Type> element) : element(element){};
+    BaseType get_base_type();
+    bool equals(Type* other);
+    bool can_assign(Type* other);
+    bool can_cast_to(Type* other);
+    bool is_rt_heap_obj();
+    const std::shared_ptr<Type> get_element();
+    std::string str() const;
+};
+
 class Adt : public Type {
    public:
     struct Constructor {
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+#include "carl/jit2/codegen2.h"
+#include "carl/jit2/optimizer.h"
+#include "llvm/Support/Error.h"
+
+namespace carl {
+
+enum class AotOutput { OBJECT, EXECUTABLE, SHARED_LIBRARY };
+
+struct AotOptions {
+    /* Backend level, the ir level is chosen with Codegen2::set_opt_level(). */
+    OptLevel opt_level = OptLevel::O2;
+    AotOutput output = AotOutput::EXECUTABLE;
+    /* Cpu to generate code for (llvm's names, e.g. x86-64-v3 or skylake).
+     * "generic" runs on every cpu of the host's architecture, "native" uses
+     * the host cpu with all of its features. */
+    std::string cpu = "generic";
+    /* Directory with libcarl-runtime.a and libcarl-runtime-main.a, empty
+     * looks next to the running executable, in ../lib relative to it (an
+     * installed carl) and in the build directory of the runtime. */
+    std::string runtime_dir;
+    /* Compiler driver that links the object with the runtime. */
+    std::string linker = "c++";
+};
+
+/*
+Ahead of time compilation of generated modules, so programs can run without
+the jit (and llvm).
+
+Executables need a module generated with Codegen2::set_entry_point(true), the
+runtime's main() calls __carl_entry. Shared libraries export __carl_main.
+Executables and shared libraries contain the runtime (carl-runtime), objects
+have to be linked against it.
+*/
+
+/* Writes module as native object for the host's architecture to path. */
+llvm::Error emit_object_file(Codegen2Module& module, const std::string& path, OptLevel level,
+                             const std::string& cpu = "generic");
+
+/* Links the object at object_path with the runtime into an executable or
+ * shared library at output_path. */
+llvm::Error link_object_file(const std::string& object_path, const std::string& output_path,
+                             const AotOptions& options);
+
+/* Emits module as options.output to output_path. */
+llvm::Error compile_ahead_of_time(Codegen2Module& module, const std::string& output_path,
+                                  const AotOptions& options);
+
+}  // namespace carl
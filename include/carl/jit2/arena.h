@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace carl {
+
+/* Counters of an arena since its last reset. */
+struct ArenaStats {
+    uint64_t num_allocations = 0;
+    uint64_t bytes_allocated = 0;
+    uint64_t bytes_reserved = 0;
+};
+
+/*
+Bump pointer allocator backing the carl runtime heap (crt_malloc).
+
+Memory is handed out from large chunks and never freed individually. reset()
+makes all chunks available again (without returning them to the os), release()
+frees everything.
+
+allocate() can be called from several threads (e.g. the workers of par_map):
+every thread bumps in a chunk of its own, only taking a new chunk locks the
+arena. reset() and release() must not run concurrently with allocate().
+*/
+class Arena {
+   public:
+    static constexpr size_t default_chunk_size = 64 * 1024;
+    static constexpr size_t alignment = 16;
+
+   private:
+    struct Chunk {
+        std::unique_ptr<char[]> memory;
+        size_t size;
+    };
+
+    size_t chunk_size;
+    std::vector<Chunk> chunks;
+    /* Index of the next chunk handed to a thread. */
+    size_t next = 0;
+    /* Changes on every reset, the chunks threads are bumping in belong to
+     * the epoch they were taken in. */
+    std::atomic<uint64_t> epoch;
+    std::atomic<uint64_t> num_allocations = 0;
+    std::atomic<uint64_t> bytes_allocated = 0;
+    std::atomic<uint64_t> bytes_reserved = 0;
+    std::mutex mutex;
+
+   public:
+    explicit Arena(size_t chunk_size = default_chunk_size);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /* Returns zeroed memory of at least size bytes. */
+    void* allocate(size_t size);
+    /* Invalidates all allocations, keeps the chunks for reuse. */
+    void reset();
+    /* Invalidates all allocations and frees all chunks. */
+    void release();
+    ArenaStats get_stats() const;
+
+   private:
+    /* Hands the current thread a chunk of at least min_size bytes. */
+    void next_chunk(size_t min_size);
+};
+
+/* Makes crt_malloc allocate from arena on the current thread while in scope. */
+class ArenaScope {
+   private:
+    Arena* previous;
+
+   public:
+    explicit ArenaScope(Arena* arena);
+    ~ArenaScope();
+};
+
+/* Arena used by crt_malloc on the current thread, nullptr means plain malloc. */
+Arena* get_current_arena();
+void set_current_arena(Arena* arena);
+
+}  // namespace carl
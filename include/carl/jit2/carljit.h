@@ -1,7 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <string>
 #include <iostream>
 #include <vector>
 
@@ -9,26 +12,134 @@
 #include "llvm/ExecutionEngine/Orc/LLJIT.h"
 #include "llvm/Support/TargetSelect.h"
 
+#include "carl/jit2/arena.h"
 #include "carl/jit2/codegen2.h"
+#include "carl/jit2/gc.h"
+#include "carl/jit2/hot_reload.h"
+#include "carl/jit2/object_cache.h"
+#include "carl/jit2/optimizer.h"
+#include "carl/jit2/thread_pool.h"
+#include "carl/jit2/tiering.h"
 
 namespace carl {
 
+struct CarlJITOptions {
+    /* Use the garbage collected heap instead of the arena. Modules loaded into
+     * the jit have to be generated with Codegen2::set_gc(true). */
+    bool gc = false;
+    /* Directory for compiled modules, see CarlJIT::cache_key(). Not with lazy
+     * or tiered: the lazy jit compiles parts of modules and tier 0 code is
+     * only valid for the jit that instrumented it, the cache is turned off
+     * with a warning. */
+    std::optional<std::string> cache_dir;
+    /* Compile functions on their first call instead of whole modules up
+     * front. */
+    bool lazy = false;
+    /* Backend level for compiling modules, the ir level is chosen with
+     * Codegen2::set_opt_level(). */
+    OptLevel opt_level = OptLevel::O2;
+    /* Compile on this many background threads instead of the calling thread.
+     * Modules are split into up to compile_threads parts that are compiled
+     * concurrently (not with cache_dir, the cache stores whole modules). */
+    unsigned compile_threads = 0;
+    /* Compile without optimisation first and recompile closure
+     * implementations and __carl_main at tier_up_level on a background thread
+     * once their calls and loop iterations reach tier_up_threshold (>= 1), see
+     * TieredCompiler. Modules have to be generated with
+     * Codegen2::set_tiered(true). */
+    bool tiered = false;
+    uint64_t tier_up_threshold = 1000;
+    OptLevel tier_up_level = OptLevel::O2;
+    /* Threads par_map and par_reduce split arrays across (including the
+     * calling one), 0 uses one per core. The pool is started on the first
+     * call. With gc the loops run on the calling thread, the collector only
+     * knows about one stack. */
+    unsigned parallel_threads = 0;
+    /* Load scripts with reload_module(), later versions of a script only
+     * compile the functions that changed. Needs modules generated with
+     * Codegen2::set_hot_reload(true), not with lazy, tiered or cache_dir. */
+    bool hot_reload = false;
+};
+
 class CarlJIT {
        private:
+        CarlJITOptions options;
+        std::unique_ptr<CarlObjectCache> object_cache;
         std::unique_ptr<llvm::orc::LLJIT> lljit;
+        /* Declared after lljit, its worker thread has to stop first. */
+        std::unique_ptr<TieredCompiler> tiering;
+        std::unique_ptr<HotReloader> hot_reloader;
         llvm::ExitOnError exitErr;
+        /* Functions the jit generated machine code for. */
+        std::mutex compiled_mutex;
+        std::set<std::string> compiled_functions;
+        /* Runtime heap of the generated code, see reset_heap(). */
+        Arena heap;
+        std::unique_ptr<GcHeap> gc_heap;
+        std::once_flag thread_pool_started;
+        std::unique_ptr<ThreadPool> thread_pool;
 
        public:
         std::ostream* outs = nullptr;
         std::vector<uint64_t> debug_values;
 
        public:
-        CarlJIT();
+        CarlJIT(CarlJITOptions options = {});
+        ~CarlJIT();
         void register_host_function(const char* name, void* addr);
         void set_outs(std::ostream* os);
         void write_outs(const char* s);
         std::optional<llvm::orc::ResourceTrackerSP> load_module(Codegen2Module &module);
+        /* With CarlJITOptions::hot_reload: loads the first or a new version of
+         * a script, see HotReloader. Lookups of its functions (e.g.
+         * __carl_main) stay valid across reloads. Must not be called while
+         * generated code runs. */
+        std::optional<HotReloadStats> reload_module(Codegen2Module& module);
         std::optional<llvm::orc::ExecutorAddr> lookup_ea(const char* name);
         std::optional<void*> lookup(const char* name);
+
+        /* With CarlJITOptions::cache_dir: modules generated with
+         * Codegen2::init(cache_key(source, codegen)) are stored in the cache
+         * when they are compiled. On the next run load_cached() with the same
+         * key loads the object directly, so parsing and code generation can
+         * be skipped. The key covers the options of the jit and of codegen
+         * (set them before calling this), see also
+         * CarlObjectCache::make_key(). */
+        std::string cache_key(const std::string& source, const Codegen2& codegen) const;
+        std::optional<llvm::orc::ResourceTrackerSP> load_cached(const std::string& key);
+        bool has_object_cache() const { return object_cache != nullptr; }
+
+        /* Whether function was compiled from ir (not yet with lazy, not for
+         * objects from the cache). */
+        bool is_compiled(const std::string& function);
+
+        /* Arena all crt_malloc calls on the thread that created the jit go to. */
+        Arena& get_heap();
+        /* Counters of the runtime heap since the last reset. */
+        ArenaStats get_heap_stats() const;
+        /* Free everything allocated by generated code (e.g. after running
+         * __carl_main), returns the counters of the finished run. */
+        ArenaStats reset_heap();
+        /* Like reset_heap() but also gives the memory back to the os. */
+        ArenaStats release_heap();
+
+        /* Only available with CarlJITOptions::gc. */
+        GcHeap* get_gc_heap();
+        void collect_garbage();
+        GcStats get_gc_stats() const;
+
+        /* Only available with CarlJITOptions::tiered. */
+        void request_tier_up(uint64_t id, void** slot);
+        /* Blocks until all pending recompilations are installed. */
+        void wait_for_tier_ups();
+        TieringStats get_tiering_stats() const;
+
+        /* Pool of the parallel array builtins. */
+        ThreadPool& get_thread_pool();
+        /* Counters of the pool, zero if it was never started. */
+        ThreadPoolStats get_thread_pool_stats() const;
+
+       private:
+        void attach_gc_root_chain();
 };
 }  // namespace carl
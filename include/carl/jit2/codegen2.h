@@ -1,9 +1,15 @@
 #pragma once
 
+#include <list>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "carl/ast/ast.h"
+#include "carl/ast/intrinsics.h"
+#include "carl/jit2/optimizer.h"
 #include "carl/name_environment.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
@@ -17,20 +23,38 @@ namespace carl {
 class Codegen2Module {
    private:
     llvm::orc::ThreadSafeModule module;
+    std::string main_name;
+    std::string entry_name;
 
    public:
-    Codegen2Module(llvm::orc::ThreadSafeModule&& tsm)
-        : module(std::move(tsm)){};
+    Codegen2Module(llvm::orc::ThreadSafeModule&& tsm, std::string main_name = "__carl_main",
+                   std::string entry_name = "__carl_entry")
+        : module(std::move(tsm)), main_name(std::move(main_name)), entry_name(std::move(entry_name)){};
 
     llvm::orc::ThreadSafeModule&& take_llvm_module() {
         return std::move(module);
     }
+    /* Function running the top level code, only differs from __carl_main for
+     * the lines of Codegen2::set_incremental(). */
+    const std::string& get_main_name() const { return main_name; }
+    /* Same for __carl_entry, see Codegen2::set_entry_point(). */
+    const std::string& get_entry_name() const { return entry_name; }
 };
 
 class Value {
     public:
     bool is_alloca = false;
     bool is_global = false;
+    /* Set for names bound by a fn declaration, calls can go directly to the
+     * _impl function instead of through the crt_fn. */
+    llvm::Function* fn_impl = nullptr;
+    bool fn_has_captures = false;
+    /* crt_fn and captures are allocas of the declaring function. */
+    bool fn_on_stack = false;
+    /* Size of the data buffer of a string variable's value if only the
+     * variable refers to it, 0 otherwise. s = s + ... appends in place
+     * while it is set, see Codegen2::append_to_string(). */
+    llvm::AllocaInst* string_capacity = nullptr;
     private:
     llvm::Value* value = nullptr;
 
@@ -39,6 +63,15 @@ class Value {
         is_alloca = true;
         value = local;
     }
+    /* Top level definition of an incremental session, see
+     * Codegen2::set_incremental(). */
+    Value(llvm::GlobalVariable* global) {
+        is_global = true;
+        value = global;
+    }
+    /* fn without an alloca, either without captures (the crt_fn is a
+     * constant) or referring to itself before its crt_fn exists. */
+    Value(llvm::Function* impl, bool has_captures) : fn_impl(impl), fn_has_captures(has_captures) {}
     llvm::AllocaInst* as_alloca() const {
         return static_cast<llvm::AllocaInst*>(value);
     }
@@ -47,7 +80,6 @@ class Value {
     }
     llvm::Type* get_type() const {
         if (is_alloca) return static_cast<llvm::AllocaInst*>(value)->getAllocatedType();
-        // TODO: check if this is the correct type to cast to!
         else if (is_global) return static_cast<llvm::GlobalVariable*>(value)->getValueType();
         return nullptr;
     }
@@ -57,16 +89,83 @@ class Codegen2 : public AstNodeVisitor {
    private:
     llvm::Value* result;
     bool has_error = false;
+    /* Emit shadow stack gc roots and safepoints. */
+    bool gc = false;
+    OptLevel opt_level = OptLevel::O2;
+    bool entry_point = false;
+    bool hot_reload = false;
+    bool incremental = false;
+    bool print_ir = true;
+    bool tiered = false;
+    /* Host target, the optimizer needs it for its cost model. */
+    std::unique_ptr<llvm::TargetMachine> target_machine;
     std::unique_ptr<llvm::LLVMContext> context;
     std::unique_ptr<llvm::IRBuilder<>> builder;
     std::unique_ptr<llvm::Module> module;
 
     Environment<Value> named_values;
+    /* The _impl functions being generated, innermost last. */
+    struct FunctionContext {
+        llvm::Function* fn;
+        /* Start of the body after the prologue. */
+        llvm::BasicBlock* tail_recurse = nullptr;
+        std::vector<Value> formals;
+    };
+    std::vector<FunctionContext> functions;
+    /* Set while generating the call of a return statement. */
+    bool tail_position = false;
+    /* Constant crt_string for each string literal in the module. */
+    std::map<std::string, llvm::GlobalVariable*> string_literals;
+    /* Constant crt_fn for each function that needs no captures. */
+    std::map<llvm::Function*, llvm::GlobalVariable*> static_closures;
+
+    /* Top level definition of an earlier line in incremental mode. The
+     * symbols carry the number of the defining line (e.g. x.3), names of the
+     * script can not clash with them. */
+    struct SessionGlobal {
+        std::shared_ptr<types::Type> type;
+        /* Global variable of a let or of the crt_fn of a fn with captures. */
+        std::string symbol;
+        /* _impl function of a fn. */
+        std::string impl_symbol;
+    };
+    std::map<std::string, SessionGlobal> session_globals;
+    /* Definitions of the current line, added to session_globals once the
+     * line generated without errors. */
+    std::map<std::string, SessionGlobal> line_globals;
+    uint64_t line = 0;
 
    public:
     Codegen2();
     void init(std::string module_name);
     Codegen2Module generate(std::vector<std::shared_ptr<AstNode>> declarations);
+    /* Whether the last generate() reported an error, its module is
+     * incomplete then. */
+    bool get_has_error() const { return has_error; }
+    /* Needed to run the generated code with CarlJITOptions::gc. */
+    void set_gc(bool enabled) { gc = enabled; }
+    void set_opt_level(OptLevel level);
+    /* Also emit void __carl_entry() which prints what __carl_main returns,
+     * the main function of executables built ahead of time calls it. */
+    void set_entry_point(bool enabled) { entry_point = enabled; }
+    /* Needed for CarlJIT::reload_module(), functions are not inlined into
+     * each other so they can be replaced one by one. */
+    void set_hot_reload(bool enabled) { hot_reload = enabled; }
+    /* Every generate() call is the next line of one session (e.g. the repl),
+     * its module is loaded into the same jit as the earlier ones. Top level
+     * lets and fns become external globals and functions, later lines only
+     * declare the ones they use, so generating a line does not depend on the
+     * size of the session. The entry functions are named after the line, see
+     * Codegen2Module. Not with gc, the globals are no roots. */
+    void set_incremental(bool enabled) { incremental = enabled; }
+    /* Print the unoptimized module to stdout while generating it. */
+    void set_print_ir(bool enabled) { print_ir = enabled; }
+    /* For CarlJITOptions::tiered: the module is left unoptimized (tier 0),
+     * the jit optimizes the functions that get hot at its tier_up_level. */
+    void set_tiered(bool enabled) { tiered = enabled; }
+    /* Everything besides the source that changes the generated module, for
+     * CarlJIT::cache_key(). */
+    std::string get_cache_flags() const;
 
    private:
     void error(const char* error) {
@@ -87,21 +186,106 @@ class Codegen2 : public AstNodeVisitor {
                                       false);
     }
     llvm::AllocaInst* create_alloca(std::string name, llvm::Type* type) {
-        llvm::BasicBlock* bb = builder->GetInsertBlock();
-        llvm::IRBuilder<> tmp_builder(bb, bb->begin());
+        llvm::BasicBlock& entry = builder->GetInsertBlock()->getParent()->getEntryBlock();
+        llvm::IRBuilder<> tmp_builder(&entry, entry.begin());
         return tmp_builder.CreateAlloca(type, nullptr, name);
     }
+    /* Alloca for a value of a runtime heap type, registered as gc root. */
+    llvm::AllocaInst* create_root_alloca(std::string name, llvm::Type* type);
+    /* Keeps a heap value alive until the function returns. */
+    llvm::Value* root_temporary(llvm::Value* value);
+    void emit_gc_prologue(llvm::Function* fn);
+    void finish_function(llvm::Function* fn);
+    void emit_entry_point(llvm::Function* main, const std::string& name,
+                          std::optional<types::BaseType> ret_base_type);
+    /* named_values and, in incremental mode, the definitions of earlier lines,
+     * they are declared in the module on first use. */
+    bool has_named_value(const std::string& name);
+    Value& get_named_value(const std::string& name);
+    /* In incremental mode at the top level of a line. */
+    bool defines_session_global();
+    /* External global for a top level definition of this line. */
+    llvm::GlobalVariable* define_session_global(const std::string& name, std::shared_ptr<types::Type> type,
+                                                llvm::Type* llvm_type, const std::string& impl_symbol = "");
+    /* _impl function of a function of type fn_type, the captures pointer is
+     * the last parameter. */
+    llvm::FunctionType* get_impl_type(types::Fn& fn_type);
     llvm::Function* get_external_function(
         const char* name, llvm::Type* ret_type,
         std::vector<llvm::Type*> argument_types);
     llvm::Function* get_crt_malloc();
+    llvm::Function* get_crt_malloc_traced();
+    llvm::Function* get_crt_gc_safepoint();
     llvm::Function* get_crt_string__concat();
+    llvm::Function* get_crt_string__concat_n();
+    llvm::Function* get_crt_string__append_n();
+    void concat_strings(Binary* binary);
+    /* Array of the crt_string pointers for the _n helpers. */
+    llvm::Value* create_string_parts(const std::vector<llvm::Value*>& parts);
+    /* s = s + a + ... as one append to the buffer of s, false if assignment
+     * is no such append. */
+    bool append_to_string(Assignment* assignment, const Value& target, const std::string& name);
+    /* Value of a local variable, string variables get their capacity slot. */
+    Value create_local(llvm::AllocaInst* alloca, const std::shared_ptr<types::Type>& type);
+    /* The variable got a new value or its value escaped. */
+    void reset_string_capacity(const Value& value);
+    llvm::Function* get_crt_array__new();
+    llvm::Function* get_crt_array__index_error();
+    llvm::Function* get_crt_par_map();
+    llvm::Function* get_crt_par_reduce();
+    /* Array of len zeroed elements. */
+    llvm::Value* new_array(llvm::Value* len, bool elements_traced);
+    /* Type based alias info for the array headers and elements, name is a
+     * crt_array field or "element". */
+    llvm::MDNode* get_array_tbaa(const char* name);
+    /* crt_array::len (0) or crt_array::data (2) of array. */
+    llvm::Value* load_array_field(llvm::Value* array, unsigned field, const char* name);
+    /* Address of the indexed element, after the bounds check. */
+    llvm::Value* array_element_ptr(Index* index);
+    void intrinsic_call(Call* call, Intrinsic intrinsic);
+    /* map, filter and fold calls nested in call as one loop. */
+    void array_pipeline(Call* call);
+    bool is_array_stage(const std::shared_ptr<Expression>& expr);
+    /* par_map and par_reduce, the runtime runs the loop on its thread pool. */
+    void parallel_call(Call* call, Intrinsic intrinsic);
+    /* Capture pointer for a direct call of a known fn, nullptr if only an
+     * indirect call through the crt_fn works from here. */
+    llvm::Value* direct_call_captures(const Value& callee);
+    /* The crt_fn of a closure with captures can be loaded from here. */
+    bool closure_in_reach(const Value& v);
     llvm::Function* start_function(const char* name, llvm::Type* ret_type);
+    /* Captures of fndecl that are copied into its crt_fn, functions defining
+     * a session global read the other session globals directly, later lines
+     * may assign to them. */
+    std::list<std::shared_ptr<Variable>> get_captures(FnDecl* fndecl);
+    /* Struct with one field per capture, crt_fn::captures points to it. */
+    llvm::StructType* get_captures_type(FnDecl* fndecl, const std::list<std::shared_ptr<Variable>>& captures);
+    /* crt_fn of a function without captures. */
+    llvm::Constant* get_static_closure(llvm::Function* impl);
+    /* crt_fn object for impl with the values stored into its captures struct,
+     * traced marks the values the gc has to follow. */
+    llvm::Value* create_closure(llvm::Function* impl, llvm::StructType* captures_type,
+                                const std::vector<llvm::Value*>& captures, const std::vector<bool>& traced,
+                                bool on_stack);
+    void partial_application(Call* call);
+    /* Turns return f(...) inside f into a jump, false if call is no self
+     * recursive call. */
+    bool self_tail_call(Call* call);
+    void mark_tail_call(llvm::CallInst* call, const Value& callee);
+    /* Calls a closure, directly through impl if it is known. wrapper is the
+     * crt_fn, only needed for the captures if impl is known. */
+    llvm::CallInst* call_closure(llvm::Value* wrapper, llvm::Function* impl, std::vector<llvm::Value*> arguments,
+                                 llvm::Type* ret_type);
+    /* f . g . h as one function calling all stages. */
+    void compose_functions(Binary* binary);
 
     /* --------------- visitor methods -------------- */
     void visit_exprstmt(ExprStmt* exprstmt);
+    void visit_whilestmt(WhileStmt* whilestmt);
+    void visit_assignment(Assignment* assignment);
     void visit_binary(Binary* binary);
     void visit_number(Number* number);
+    void visit_literal(Literal* literal);
     void visit_string(String* number);
     void visit_letdecl(LetDecl* letdecl);
     void visit_variable(Variable* variable);
@@ -109,6 +293,9 @@ class Codegen2 : public AstNodeVisitor {
     void visit_fndecl(FnDecl* fndecl);
     void visit_block(Block* block);
     void visit_call(Call* call);
+    void visit_arrayliteral(ArrayLiteral* arrayliteral);
+    void visit_arrayrepeat(ArrayRepeat* arrayrepeat);
+    void visit_index(Index* index);
 };
 
 }  // namespace carl
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+#include "carl/jit2/runtime_types.h"
+
+namespace carl {
+
+struct GcStats {
+    uint64_t num_allocations = 0;
+    uint64_t num_collections = 0;
+    uint64_t objects_live = 0;
+    uint64_t bytes_live = 0;
+    uint64_t objects_freed = 0;
+    uint64_t bytes_freed = 0;
+};
+
+/*
+Precise mark and sweep collector for the carl runtime heap.
+
+Every object is preceded by a crt_gc_header whose ptr_mask says which payload
+words may point to other objects. Roots are the heap typed stack slots of the
+generated code, which llvm links into llvm_gc_root_chain (shadow-stack gc
+strategy), plus slots registered by the host with add_root().
+
+Collections only happen at explicit safepoints (function entries in generated
+code or collect() from the host), never inside an allocation. That way the
+runtime functions do not need to root their intermediate objects.
+*/
+class GcHeap {
+   public:
+    static constexpr size_t default_threshold = 1024 * 1024;
+
+   private:
+    /* Layout of the frames llvm's shadow stack lowering generates. */
+    struct FrameMap {
+        int32_t num_roots;
+        int32_t num_meta;
+        const void* meta[0];
+    };
+    struct StackEntry {
+        StackEntry* next;
+        const FrameMap* map;
+        void* roots[0];
+    };
+
+    std::unordered_set<crt_gc_header*> objects;
+    std::vector<void**> host_roots;
+    StackEntry** root_chain = nullptr;
+    std::vector<crt_gc_header*> mark_stack;
+    size_t threshold;
+    size_t min_threshold;
+    size_t bytes_since_collect = 0;
+    GcStats stats;
+
+   public:
+    explicit GcHeap(size_t threshold = default_threshold);
+    GcHeap(const GcHeap&) = delete;
+    GcHeap& operator=(const GcHeap&) = delete;
+    ~GcHeap();
+
+    /* Returns zeroed memory, bit i of ptr_mask marks payload word i as a
+     * (possible) reference. CRT_GC_SCAN_ALL scans every payload word. */
+    void* allocate(size_t size, uint64_t ptr_mask);
+    /* Collects if enough has been allocated since the last collection. */
+    void safepoint();
+    void collect();
+
+    /* Address of llvm_gc_root_chain in the jit'd code. */
+    void set_root_chain(void* chain) { root_chain = static_cast<StackEntry**>(chain); }
+    void add_root(void** slot);
+    void remove_root(void** slot);
+    /* 0 collects at every safepoint. */
+    void set_threshold(size_t bytes);
+    const GcStats& get_stats() const { return stats; }
+
+   private:
+    void mark(void* ptr);
+    void trace(crt_gc_header* object);
+    void sweep();
+};
+
+/* Gc heap used by crt_malloc on the current thread (takes precedence over the
+ * current arena). */
+GcHeap* get_current_gc_heap();
+void set_current_gc_heap(GcHeap* heap);
+
+}  // namespace carl
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/IR/Module.h"
+
+namespace carl {
+
+struct HotReloadStats {
+    /* Functions of the module that were compiled (new or changed). */
+    uint64_t num_compiled = 0;
+    /* Functions that were the same as in the loaded version and kept their
+     * code. */
+    uint64_t num_unchanged = 0;
+    /* Old versions whose code was removed from the jit. */
+    uint64_t num_removed = 0;
+};
+
+/*
+Loads versions of the same script so that only functions that changed get
+compiled again.
+
+Every function of a module goes into its own module and resource tracker, with
+the constants it uses as private copies. Everything refers to a function
+through an indirect stub that has the function's name (e.g. crt_fn objects,
+calls from other functions and the host's lookup of __carl_main), the code
+itself is named <name>.v<version>. A reload compares each function with the
+loaded version, compiles the changed ones, points their stubs at the new code
+and removes the old code through its tracker.
+
+A changed signature also changes the callers (their calls differ), so they are
+compiled again as well. Functions that disappear from the script keep their
+code. Modules have to be generated with Codegen2::set_hot_reload(true),
+otherwise functions may be inlined into each other. Generated code must not run
+while a reload removes code it may be executing.
+*/
+class HotReloader {
+   private:
+    struct LoadedFunction {
+        /* Printed module of the function, decides whether a reload has to
+         * compile it again. */
+        std::string ir;
+        uint64_t version = 0;
+        llvm::orc::ResourceTrackerSP tracker;
+    };
+
+    llvm::orc::LLJIT& jit;
+    std::unique_ptr<llvm::orc::IndirectStubsManager> stubs;
+    std::map<std::string, LoadedFunction> functions;
+    /* Mutable globals (e.g. the gc root chain) are defined once and shared by
+     * all versions. */
+    std::set<std::string> globals;
+
+   public:
+    explicit HotReloader(llvm::orc::LLJIT& jit);
+    HotReloader(const HotReloader&) = delete;
+    HotReloader& operator=(const HotReloader&) = delete;
+
+    llvm::Expected<HotReloadStats> load(llvm::orc::ThreadSafeModule tsm);
+
+   private:
+    llvm::Error load_globals(llvm::orc::ThreadSafeModule& tsm);
+    llvm::Error create_stub(const std::string& name);
+};
+
+}  // namespace carl
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace carl {
+
+/*
+On disk cache of compiled carl modules.
+
+Modules are cached under their module identifier, which has to be a key made by
+make_key() (i.e. Codegen2::init(key)). Modules with other names are ignored.
+*/
+class CarlObjectCache : public llvm::ObjectCache {
+   private:
+    std::string directory;
+
+   public:
+    explicit CarlObjectCache(std::string directory);
+
+    /* Identifies the compiled code of source, flags has to contain everything
+     * else that changes the generated code (e.g. codegen options). The key
+     * also covers the host cpu and its features, the llvm version and the
+     * carl build (version, cache format and the executable itself). */
+    static std::string make_key(const std::string& source, const std::string& flags = "");
+
+    void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+    std::unique_ptr<llvm::MemoryBuffer> get_object(const std::string& key);
+
+   private:
+    static bool is_key(const std::string& name);
+    std::string path_of(const std::string& key) const;
+};
+
+}  // namespace carl
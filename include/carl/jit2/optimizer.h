@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace carl {
+
+enum class OptLevel { O0, O1, O2, O3, Os };
+
+/* Parses the part after -O, i.e. "0", "1", "2", "3" or "s". */
+std::optional<OptLevel> parse_opt_level(const std::string& level);
+/* "O0", "O1", ... */
+const char* opt_level_name(OptLevel level);
+
+/* Backend (instruction selection, register allocation) level for level. */
+llvm::CodeGenOpt::Level codegen_opt_level(OptLevel level);
+
+/* Target machine for the cpu we are running on, with all of its features
+ * enabled (e.g. AVX2/AVX-512). */
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>> create_host_target_machine(OptLevel level);
+
+/* Runs llvm's default module pipeline for level on module. With a target
+ * machine the passes use its cost model (e.g. for vectorization). */
+void optimize_module(llvm::Module& module, OptLevel level, llvm::TargetMachine* target_machine = nullptr);
+
+}  // namespace carl
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "carl/ast/ast.h"
+#include "carl/ast/type_inference.h"
+#include "carl/jit2/carljit.h"
+#include "carl/jit2/codegen2.h"
+#include "carl/parser.h"
+
+namespace carl {
+
+/*
+Interactive session, every line is compiled into its own module and loaded
+into the same jit.
+
+The parser and the type inference keep their environments across lines, the
+code generator runs in incremental mode (see Codegen2::set_incremental()): top
+level lets and fns of a line become external symbols and later lines only
+declare the ones they use. Compiling a line therefore costs the same at the
+start of a session and after thousands of definitions.
+
+An expression statement at the end of a line is returned like a return
+statement, so its value is printed.
+*/
+class Repl {
+   private:
+    CarlJIT jit;
+    Parser parser;
+    TypeInference type_inference;
+    Codegen2 codegen;
+    /* The tokens of the ast point into the lines. */
+    std::deque<std::string> lines;
+    /* Declarations of the lines that compiled. */
+    std::vector<std::shared_ptr<AstNode>> declarations;
+
+    /* Takes the lets and fns of a line that failed back out of the
+     * environments, later lines can not refer to them. */
+    void forget_definitions(const std::vector<std::shared_ptr<AstNode>>& decls);
+
+   public:
+    explicit Repl(OptLevel opt_level = OptLevel::O2);
+
+    /* Parses, type checks and generates one line against the definitions of
+     * the earlier ones. Errors are reported on stderr. */
+    std::optional<Codegen2Module> compile(const std::string& line);
+    /* compile() and run the line, prints what it returns. */
+    bool eval(const std::string& line);
+
+    CarlJIT& get_jit() { return jit; }
+};
+
+}  // namespace carl
@@ -1,28 +1,72 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "carl/jit2/runtime_types.h"
 
-typedef std::size_t size_t;
-
 #define CRT_ALLOC(struct_name) ((struct_name*)crt_malloc(sizeof(struct_name)))
 
+namespace carl {
+class ThreadPool;
+
+/* Pool par_map and par_reduce run on, the jit hands out its own. Without a
+ * getter (e.g. in executables built by carl build) the runtime starts a pool
+ * with one thread per core on first use. */
+void set_thread_pool_getter(ThreadPool& (*getter)());
+}  // namespace carl
+
+/*
+Functions the generated code calls. They are part of the carl-runtime library,
+the jit binds them as host functions and executables built ahead of time link
+against the library.
+
+The small helpers in runtime_inline.cc are also linked into generated modules
+as bitcode so llvm can inline them, see link_runtime_bitcode().
+*/
 extern "C" {
 
-void* crt_malloc(size_t size) {
-    void* memory = malloc(size);
-    memset(memory, 0, size);
-    return memory;
-}
+/* Allocates an object whose payload words selected by ptr_mask may reference
+ * other runtime objects. */
+void* crt_malloc_traced(size_t size, uint64_t ptr_mask);
+
+/* Allocates an object without references. */
+void* crt_malloc(size_t size);
+
+crt_string* crt_string__concat(crt_string* a, crt_string* b);
+
+/* Concatenation of a whole chain a + b + ... with a single allocation. */
+crt_string* crt_string__concat_n(uint64_t n, crt_string** parts);
+
+/* s + parts[0] + ... for s = s + ..., capacity is the size of the buffer of s
+ * if nothing else refers to s (0 otherwise) and is updated. Grows s in place
+ * if it fits, else copies into a buffer of twice the length. */
+crt_string* crt_string__append_n(crt_string* s, uint64_t* capacity, uint64_t n, crt_string** parts);
+
+/* Array of len zeroed elements, elements_traced if they are references. */
+crt_array* crt_array__new(uint64_t len, uint64_t elements_traced);
+
+/* Array length that is negative as int. */
+void crt_array__length_error(uint64_t len);
+
+/* Failed bounds check, there is no way to recover from it in carl code. */
+void crt_array__index_error(int64_t index, uint64_t len);
+
+void crt_gc_safepoint();
+
+crt_array* crt_par_map(crt_fn* fn, crt_array* array, uint64_t element_is_float, uint64_t result_is_float,
+                       uint64_t result_traced);
+
+/* Every chunk is reduced starting from its first element, the partial results
+ * are combined in order starting from init (applied once, like fold). */
+uint64_t crt_par_reduce(crt_fn* fn, uint64_t init, crt_array* array, uint64_t is_float);
 
-crt_string* crt_string__concat(crt_string* a, crt_string* b) {
-    crt_string* result = CRT_ALLOC(crt_string);
-    result->data = (const char*)crt_malloc(a->len + b->len - 1);
-    result->len = a->len + b->len - 1;
-    memcpy((void*)result->data, a->data, a->len);
-    memcpy((void*)(result->data + a->len - 1), b->data, b->len);
-    return result;
+/* Print the result of __carl_main, see Codegen2::set_entry_point(). */
+void crt_print_int(int64_t value);
+void crt_print_bool(uint64_t value);
+void crt_print_float(double value);
+void crt_print_string(crt_string* value);
 }
-}
\ No newline at end of file
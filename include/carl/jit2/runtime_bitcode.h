@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "llvm/IR/Module.h"
+
+namespace carl {
+
+/* Links the definitions of the runtime helpers module calls (from
+ * runtime_inline.cc, built to bitcode with clang) into module as internal
+ * always inline functions, so the optimizer can inline and fold them. False if
+ * the build had no clang to produce the bitcode or linking failed, module then
+ * keeps calling the host functions. */
+bool link_runtime_bitcode(llvm::Module& module);
+
+/* Whether link_runtime_bitcode() has bitcode to link. */
+bool has_runtime_bitcode();
+
+/* Hash of the bitcode link_runtime_bitcode() links, empty without. */
+std::string runtime_bitcode_hash();
+
+}  // namespace carl
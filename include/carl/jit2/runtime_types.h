@@ -9,5 +9,25 @@ typedef struct crt_string {
 
 typedef struct crt_fn {
     void* fn_impl;
-    uint64_t* captures;
+    /* Generated struct of the closure's captured values, stored right behind
+     * the crt_fn in the same allocation. */
+    void* captures;
 } crt_fn;
+
+typedef struct crt_array {
+    uint64_t len;
+    uint64_t capacity;
+    /* capacity elements of 8 bytes each (int, bool, float or a reference)
+     * in one block, so loops over them can be vectorized. */
+    void* data;
+} crt_array;
+
+/* Precedes every object allocated on the gc heap. */
+typedef struct crt_gc_header {
+    uint64_t size;
+    uint64_t ptr_mask;
+    uint64_t marked;
+} crt_gc_header;
+
+/* ptr_mask value for objects where every word may be a reference. */
+#define CRT_GC_SCAN_ALL (~(uint64_t)0)
@@ -22,7 +22,19 @@ llvm::Type* runtime_type_llvm_get__crt_fn(llvm::LLVMContext &context) {
     if (t == nullptr) {
         t = llvm::StructType::create(llvm_type_name,
                                      llvm::PointerType::get(context, 0),
-                                     llvm::Type::getInt64PtrTy(context));
+                                     llvm::PointerType::get(context, 0));
+    }
+    return t;
+};
+
+llvm::Type* runtime_type_llvm_get__crt_array(llvm::LLVMContext &context) {
+    const char* llvm_type_name = "crt_array";
+    llvm::Type* t = llvm::StructType::getTypeByName(context, llvm_type_name);
+    if (t == nullptr) {
+        t = llvm::StructType::create(llvm_type_name,
+                                     llvm::Type::getInt64Ty(context),
+                                     llvm::Type::getInt64Ty(context),
+                                     llvm::PointerType::get(context, 0));
     }
     return t;
 };
@@ -35,9 +47,11 @@ llvm::Type* runtime_type_llvm_get__from_BaseType(carl::types::BaseType base_type
         case carl::types::BaseType::FLOAT:
             return llvm::Type::getDoubleTy(context);
         case carl::types::BaseType::STRING:
-            return runtime_type_llvm_get__crt_string(context);
+            return runtime_type_llvm_get__crt_string(context)->getPointerTo();
         case carl::types::BaseType::FN:
             return runtime_type_llvm_get__crt_fn(context)->getPointerTo();
+        case carl::types::BaseType::ARRAY:
+            return runtime_type_llvm_get__crt_array(context)->getPointerTo();
         default:
             fprintf(stderr, "ERROR in runtime_type_llvm_get__from_BaseType: unmapped type %d\n", static_cast<int>(base_type));
             return nullptr;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace carl {
+
+struct ThreadPoolStats {
+    uint64_t num_jobs = 0;
+    /* Ranges a thread took from the queue of another thread. */
+    uint64_t num_steals = 0;
+};
+
+/*
+Work stealing pool for the parallel array builtins (par_map, par_reduce).
+
+parallel_for() hands every thread (the calling one included) a contiguous part
+of the index range. A thread splits its part in halves until they are at most
+grain long, keeps working on the lower half and pushes the upper one onto the
+back of its own queue. Threads that run out of work steal from the front of
+the other queues, where the largest ranges are.
+
+One job runs at a time. Calls from inside a job (e.g. a par_map in a function
+passed to par_map) run the body on the current thread.
+*/
+class ThreadPool {
+   private:
+    struct Range {
+        uint64_t begin;
+        uint64_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    /* One queue per worker, the last one belongs to the calling thread. */
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    /* Serializes parallel_for() calls from different threads. */
+    std::mutex job_mutex;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable job_done;
+    uint64_t generation = 0;
+    /* Workers still inside the current job. */
+    unsigned num_active = 0;
+    bool stop = false;
+
+    const std::function<void(uint64_t, uint64_t)>* body = nullptr;
+    uint64_t grain = 1;
+    std::atomic<uint64_t> remaining = 0;
+    /* Threads without work block on ranges_available until a range is queued
+     * or the job is done. */
+    std::mutex ranges_mutex;
+    std::condition_variable ranges_available;
+    std::atomic<uint64_t> num_queued = 0;
+    std::atomic<unsigned> num_waiting = 0;
+
+    std::atomic<uint64_t> num_jobs = 0;
+    std::atomic<uint64_t> num_steals = 0;
+
+   public:
+    /* 0 uses one thread per core (including the calling thread). */
+    explicit ThreadPool(unsigned num_threads = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    /* Threads working on a job, the calling thread included. */
+    unsigned get_num_threads() const { return queues.size(); }
+    /* Calls body(begin, end) for disjoint ranges of at most grain indices
+     * that together cover [0, n), blocks until all calls returned. */
+    void parallel_for(uint64_t n, uint64_t grain, const std::function<void(uint64_t, uint64_t)>& body);
+    ThreadPoolStats get_stats() const;
+
+   private:
+    void run_worker(unsigned index);
+    void run_ranges(unsigned index);
+    bool pop(unsigned index, Range& range);
+    bool steal(unsigned index, Range& range);
+    void push(unsigned index, Range range);
+    void wake_waiting();
+};
+
+}  // namespace carl
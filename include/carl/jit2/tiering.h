@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "carl/jit2/optimizer.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/IR/Module.h"
+
+namespace carl {
+
+struct TieringStats {
+    /* Functions whose calls and loop iterations crossed the threshold. */
+    uint64_t num_requests = 0;
+    /* Optimized versions that are installed in their slot. */
+    uint64_t num_tier_ups = 0;
+    uint64_t num_failures = 0;
+};
+
+/*
+Second tier of the jit.
+
+instrument() prepares a module before it is added to the jit (tier 0): every
+closure implementation (*_impl) and __carl_main counts its calls (not main) and
+loop iterations and dispatches through a slot at its entry. The count that
+reaches the threshold calls crt_tier_up, the function is then recompiled at
+opt_level on a background thread and its slot is pointed at the optimized code.
+
+crt_fn objects created before the swap still point at the tier 0 code and get
+forwarded through the slot, crt_fn objects created afterwards point at the
+optimized code directly.
+*/
+class TieredCompiler {
+   private:
+    struct TieredFunction {
+        /* Bitcode of the module before instrumentation, shared by all
+         * functions of the module. */
+        std::shared_ptr<const llvm::SmallVector<char, 0>> bitcode;
+        std::string name;
+    };
+    struct Request {
+        uint64_t id;
+        void** slot;
+    };
+
+    llvm::orc::LLJIT& jit;
+    uint64_t threshold;
+    OptLevel opt_level;
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    std::vector<TieredFunction> functions;
+    uint64_t num_modules = 0;
+    std::deque<Request> queue;
+    bool busy = false;
+    bool stop = false;
+    TieringStats stats;
+    std::thread worker;
+
+   public:
+    TieredCompiler(llvm::orc::LLJIT& jit, uint64_t threshold, OptLevel opt_level);
+    TieredCompiler(const TieredCompiler&) = delete;
+    TieredCompiler& operator=(const TieredCompiler&) = delete;
+    ~TieredCompiler();
+
+    void instrument(llvm::Module& module);
+    /* Called by crt_tier_up, only enqueues the function. */
+    void request(uint64_t id, void** slot);
+    /* Blocks until all requested functions are recompiled. */
+    void wait_idle();
+    TieringStats get_stats();
+
+   private:
+    void instrument_function(llvm::Function& fn, uint64_t id, bool count_calls);
+    void run_worker();
+    llvm::Error compile(const TieredFunction& fn, void** slot);
+};
+
+}  // namespace carl
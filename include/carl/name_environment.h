@@ -64,6 +64,11 @@ class Environment {
         values.insert_or_assign(name, v);
     }
 
+    /* Only removes name from the innermost scope. */
+    void erase_variable(const std::string& name) {
+        values.erase(name);
+    }
+
     bool has_variable(const std::string& name, int min_id = 0) {
         if (id < min_id) return false;
         return values.contains(name) || (parent && parent->has_variable(name, min_id));
@@ -63,6 +63,9 @@ class Parser {
     void set_scanner(std::shared_ptr<Scanner> scanner);
 
     ParseResult parse_r(std::string& src, bool add_builtins = true, bool skip_type_checking = false);
+    /* Drops a top level let or fn of an earlier parse_r() call, e.g. of a repl
+     * line that failed later on. */
+    void forget(const std::string& name);
     std::vector<std::shared_ptr<AstNode>> parse();
     std::vector<std::shared_ptr<AstNode>> parse(std::string& src);
     std::shared_ptr<AstNode> declaration();
@@ -79,6 +82,9 @@ class Parser {
 
     std::shared_ptr<Expression> expression();
     std::shared_ptr<Expression> grouping();
+    // [1, 2, 3] or [0; n]
+    std::shared_ptr<Expression> array();
+    std::shared_ptr<Expression> index();
     std::shared_ptr<Expression> match();
     std::shared_ptr<Expression> call();
     // can be Assignment or Binary
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,8 @@ enum TokenType {
     TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACE,
     TOKEN_RIGHT_BRACE,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
     TOKEN_COMMA,
     TOKEN_DOT,
     TOKEN_MINUS,
@@ -64,6 +67,9 @@ struct Token {
     const char *start;
     int length;
     int line;
+    /* Owns the text start points to for tokens that are not part of the
+     * source (e.g. folded constants), null otherwise. */
+    std::shared_ptr<const std::string> text;
 
     operator std::string() const noexcept { return std::string(start, length); }
 };
@@ -1,12 +1,26 @@
 set(
     INCLUDE_H
     include/carl/ast/type_inference.h
+    include/carl/ast/constant_folding.h
+    include/carl/ast/escape_analysis.h
+    include/carl/ast/intrinsics.h
     include/carl/ast/print_visitor.h
     include/carl/ast/ast_printer.h
     include/carl/ast/ast.h
     include/carl/ast/types.h
+    include/carl/jit2/aot.h
+    include/carl/jit2/arena.h
     include/carl/jit2/carljit.h
     include/carl/jit2/codegen2.h
+    include/carl/jit2/gc.h
+    include/carl/jit2/hot_reload.h
+    include/carl/jit2/object_cache.h
+    include/carl/jit2/optimizer.h
+    include/carl/jit2/repl.h
+    include/carl/jit2/runtime.h
+    include/carl/jit2/runtime_bitcode.h
+    include/carl/jit2/thread_pool.h
+    include/carl/jit2/tiering.h
     include/carl/scanner.h
     include/carl/parser.h
     include/carl/name_environment.h
@@ -21,6 +21,10 @@ void Literal::accept(AstNodeVisitor* visitor) { visitor->visit_literal(this); }
 void String::accept(AstNodeVisitor* visitor) { visitor->visit_string(this); }
 void Number::accept(AstNodeVisitor* visitor) { visitor->visit_number(this); }
 void Call::accept(AstNodeVisitor* visitor) { visitor->visit_call(this); }
+void Placeholder::accept(AstNodeVisitor* visitor) { visitor->visit_placeholder(this); }
+void ArrayLiteral::accept(AstNodeVisitor* visitor) { visitor->visit_arrayliteral(this); }
+void ArrayRepeat::accept(AstNodeVisitor* visitor) { visitor->visit_arrayrepeat(this); }
+void Index::accept(AstNodeVisitor* visitor) { visitor->visit_index(this); }
 void MatchArm::accept(AstNodeVisitor* visitor) { visitor->visit_matcharm(this); }
 void Match::accept(AstNodeVisitor* visitor) { visitor->visit_match(this); }
 
@@ -43,6 +47,10 @@ AstNodeType Literal::get_node_type() const { return AstNodeType::Literal; }
 AstNodeType String::get_node_type() const { return AstNodeType::String; }
 AstNodeType Number::get_node_type() const { return AstNodeType::Number; }
 AstNodeType Call::get_node_type() const { return AstNodeType::Call; }
+AstNodeType Placeholder::get_node_type() const { return AstNodeType::Placeholder; }
+AstNodeType ArrayLiteral::get_node_type() const { return AstNodeType::ArrayLiteral; }
+AstNodeType ArrayRepeat::get_node_type() const { return AstNodeType::ArrayRepeat; }
+AstNodeType Index::get_node_type() const { return AstNodeType::Index; }
 AstNodeType MatchArm::get_node_type() const { return AstNodeType::MatchArm; }
 AstNodeType Match::get_node_type() const { return AstNodeType::Match; }
 
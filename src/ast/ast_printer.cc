@@ -65,6 +65,8 @@ void AstPrinter::visit_fndecl(FnDecl* fndecl) {
     indent--;
     write_indent();
     os << ".is_extern = " << (fndecl->get_is_extern() ? std::string("true") : std::string("false")) << "\n";
+    write_indent();
+    os << ".escapes = " << (fndecl->get_escapes() ? std::string("true") : std::string("false")) << "\n";
     indent--;
 }
 
@@ -231,6 +233,71 @@ void AstPrinter::visit_call(Call* call) {
         elem->accept(this);
     }
     indent--;
+    write_indent();
+    os << ".is_partial = " << (call->get_is_partial() ? std::string("true") : std::string("false")) << "\n";
+    indent--;
+}
+
+void AstPrinter::visit_placeholder(Placeholder* placeholder) {
+    write_indent();
+    os << "Placeholder [" << placeholder->get_type()->str() << "]\n"; 
+    indent++;
+    write_indent();
+    os << ".token = " << std::string(placeholder->get_token().start, placeholder->get_token().length) << "\n";
+    indent--;
+}
+
+void AstPrinter::visit_arrayliteral(ArrayLiteral* arrayliteral) {
+    write_indent();
+    os << "ArrayLiteral [" << arrayliteral->get_type()->str() << "]\n"; 
+    indent++;
+    write_indent();
+    os << ".bracket = " << std::string(arrayliteral->get_bracket().start, arrayliteral->get_bracket().length) << "\n";
+    write_indent();
+    os << ".elements\n";
+    indent++;
+    for (auto& elem : arrayliteral->get_elements()) {
+        elem->accept(this);
+    }
+    indent--;
+    indent--;
+}
+
+void AstPrinter::visit_arrayrepeat(ArrayRepeat* arrayrepeat) {
+    write_indent();
+    os << "ArrayRepeat [" << arrayrepeat->get_type()->str() << "]\n"; 
+    indent++;
+    write_indent();
+    os << ".bracket = " << std::string(arrayrepeat->get_bracket().start, arrayrepeat->get_bracket().length) << "\n";
+    write_indent();
+    os << ".value\n";
+    indent++;
+    arrayrepeat->get_value()->accept(this);
+    indent--;
+    write_indent();
+    os << ".count\n";
+    indent++;
+    arrayrepeat->get_count()->accept(this);
+    indent--;
+    indent--;
+}
+
+void AstPrinter::visit_index(Index* index) {
+    write_indent();
+    os << "Index [" << index->get_type()->str() << "]\n"; 
+    indent++;
+    write_indent();
+    os << ".bracket = " << std::string(index->get_bracket().start, index->get_bracket().length) << "\n";
+    write_indent();
+    os << ".array\n";
+    indent++;
+    index->get_array()->accept(this);
+    indent--;
+    write_indent();
+    os << ".index\n";
+    indent++;
+    index->get_index()->accept(this);
+    indent--;
     indent--;
 }
 
@@ -0,0 +1,506 @@
+#include "carl/ast/constant_folding.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+using namespace carl;
+
+namespace {
+
+/* Collects the names that are assigned to, they are not constant. */
+class AssignmentTargets : public AstNodeVisitor {
+   public:
+    std::set<std::string> names;
+
+    void walk(const std::shared_ptr<AstNode>& node) { node->accept(this); }
+
+    void visit_type(Type* type) {}
+    void visit_formalparam(FormalParam* formalparam) {}
+    void visit_fndecl(FnDecl* fndecl) {
+        if (!fndecl->get_is_extern()) walk(fndecl->get_body());
+    }
+    void visit_letdecl(LetDecl* letdecl) { walk(letdecl->get_initializer()); }
+    void visit_adtstmt(AdtStmt* adtstmt) {}
+    void visit_exprstmt(ExprStmt* exprstmt) { walk(exprstmt->get_expr()); }
+    void visit_returnstmt(ReturnStmt* returnstmt) { walk(returnstmt->get_expr()); }
+    void visit_whilestmt(WhileStmt* whilestmt) {
+        walk(whilestmt->get_condition());
+        walk(whilestmt->get_body());
+    }
+    void visit_block(Block* block) {
+        for (auto& decl : block->get_declarations()) walk(decl);
+    }
+    void visit_assignment(Assignment* assignment) {
+        auto target = assignment->get_target();
+        if (target->get_node_type() == AstNodeType::Variable) {
+            names.insert(std::static_pointer_cast<Variable>(target)->get_name());
+        }
+        walk(target);
+        walk(assignment->get_expr());
+    }
+    void visit_binary(Binary* binary) {
+        walk(binary->get_lhs());
+        walk(binary->get_rhs());
+    }
+    void visit_unary(Unary* unary) { walk(unary->get_operand()); }
+    void visit_variable(Variable* variable) {}
+    void visit_literal(Literal* literal) {}
+    void visit_string(String* string) {}
+    void visit_number(Number* number) {}
+    void visit_call(Call* call) {
+        for (auto& argument : call->get_arguments()) walk(argument);
+    }
+    void visit_placeholder(Placeholder* placeholder) {}
+    void visit_arrayliteral(ArrayLiteral* arrayliteral) {
+        for (auto& element : arrayliteral->get_elements()) walk(element);
+    }
+    void visit_arrayrepeat(ArrayRepeat* arrayrepeat) {
+        walk(arrayrepeat->get_value());
+        walk(arrayrepeat->get_count());
+    }
+    void visit_index(Index* index) {
+        walk(index->get_array());
+        walk(index->get_index());
+    }
+    void visit_matcharm(MatchArm* matcharm) { walk(matcharm->get_result()); }
+    void visit_match(Match* match) {
+        walk(match->get_matchee());
+        for (auto& arm : match->get_arms()) walk(arm);
+    }
+};
+
+}  // namespace
+
+/* Folded values are not part of the source, their tokens own their text. */
+static Token make_token(const Token& at, TokenType type, std::string text) {
+    auto owned = std::make_shared<const std::string>(std::move(text));
+    return Token{.type = type, .start = owned->c_str(), .length = static_cast<int>(owned->size()),
+                 .line = at.line, .text = owned};
+}
+
+static std::shared_ptr<Expression> make_int(const Token& at, int64_t value) {
+    auto number = std::make_shared<Number>(make_token(at, TOKEN_NUMBER, std::to_string(value)));
+    number->set_type(std::make_shared<types::Int>());
+    return number;
+}
+
+static std::shared_ptr<Expression> make_float(const Token& at, double value) {
+    if (!std::isfinite(value)) return nullptr;
+    char buffer[64];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    std::string text(buffer, end);
+    if (text.find_first_of(".e") == std::string::npos) text += ".0";
+
+    auto number = std::make_shared<Number>(make_token(at, TOKEN_NUMBER, text));
+    number->set_type(std::make_shared<types::Float>());
+    return number;
+}
+
+static std::shared_ptr<Expression> make_bool(const Token& at, bool value) {
+    auto token = make_token(at, value ? TOKEN_TRUE : TOKEN_FALSE, value ? "true" : "false");
+    auto literal = std::make_shared<Literal>(token);
+    literal->set_type(std::make_shared<types::Bool>());
+    return literal;
+}
+
+static std::shared_ptr<Expression> make_string(const Token& at, const std::string& value) {
+    auto string = std::make_shared<String>(make_token(at, TOKEN_STRING, "\"" + value + "\""));
+    string->set_type(std::make_shared<types::String>());
+    return string;
+}
+
+static bool is_literal(const std::shared_ptr<Expression>& expr) {
+    auto node_type = expr->get_node_type();
+    return node_type == AstNodeType::Number || node_type == AstNodeType::String ||
+           node_type == AstNodeType::Literal;
+}
+
+static int64_t int_value(const std::shared_ptr<Expression>& expr) {
+    return strtoll(std::static_pointer_cast<Number>(expr)->get_value().start, nullptr, 10);
+}
+
+static double float_value(const std::shared_ptr<Expression>& expr) {
+    return strtod(std::static_pointer_cast<Number>(expr)->get_value().start, nullptr);
+}
+
+static bool bool_value(const std::shared_ptr<Expression>& expr) {
+    return std::static_pointer_cast<Literal>(expr)->get_value().type == TOKEN_TRUE;
+}
+
+static std::string string_value(const std::shared_ptr<Expression>& expr) {
+    const Token& value = std::static_pointer_cast<String>(expr)->get_value();
+    return std::string(value.start + 1, value.length - 2);
+}
+
+static std::shared_ptr<Expression> fold_int(const Token& op, int64_t a, int64_t b) {
+    /* Like the generated code, + - * wrap around */
+    auto ua = static_cast<uint64_t>(a);
+    auto ub = static_cast<uint64_t>(b);
+    switch (op.type) {
+        case TOKEN_PLUS:
+            return make_int(op, static_cast<int64_t>(ua + ub));
+        case TOKEN_MINUS:
+            return make_int(op, static_cast<int64_t>(ua - ub));
+        case TOKEN_STAR:
+            return make_int(op, static_cast<int64_t>(ua * ub));
+        case TOKEN_SLASH:
+        case TOKEN_PERC:
+            if (b == 0 || (a == std::numeric_limits<int64_t>::min() && b == -1)) return nullptr;
+            return make_int(op, op.type == TOKEN_SLASH ? a / b : a % b);
+        case TOKEN_EQUAL_EQUAL:
+            return make_bool(op, a == b);
+        case TOKEN_BANG_EQUAL:
+            return make_bool(op, a != b);
+        case TOKEN_LESS:
+            return make_bool(op, a < b);
+        case TOKEN_LESS_EQUAL:
+            return make_bool(op, a <= b);
+        case TOKEN_GREATER:
+            return make_bool(op, a > b);
+        case TOKEN_GREATER_EQUAL:
+            return make_bool(op, a >= b);
+        default:
+            return nullptr;
+    }
+}
+
+static std::shared_ptr<Expression> fold_float(const Token& op, double a, double b) {
+    switch (op.type) {
+        case TOKEN_PLUS:
+            return make_float(op, a + b);
+        case TOKEN_MINUS:
+            return make_float(op, a - b);
+        case TOKEN_STAR:
+            return make_float(op, a * b);
+        case TOKEN_SLASH:
+            return make_float(op, a / b);
+        case TOKEN_EQUAL_EQUAL:
+            return make_bool(op, a == b);
+        case TOKEN_BANG_EQUAL:
+            return make_bool(op, a != b);
+        case TOKEN_LESS:
+            return make_bool(op, a < b);
+        case TOKEN_LESS_EQUAL:
+            return make_bool(op, a <= b);
+        case TOKEN_GREATER:
+            return make_bool(op, a > b);
+        case TOKEN_GREATER_EQUAL:
+            return make_bool(op, a >= b);
+        default:
+            return nullptr;
+    }
+}
+
+static std::shared_ptr<Expression> fold_bool(const Token& op, bool a, bool b) {
+    switch (op.type) {
+        case TOKEN_EQUAL_EQUAL:
+            return make_bool(op, a == b);
+        case TOKEN_BANG_EQUAL:
+            return make_bool(op, a != b);
+        default:
+            return nullptr;
+    }
+}
+
+/* Stages of f . g . k in the order they are written. */
+static void collect_composition_stages(const std::shared_ptr<Expression>& expr,
+                                       std::vector<std::shared_ptr<Expression>>& stages) {
+    if (expr->get_node_type() == AstNodeType::Binary) {
+        auto binary = std::static_pointer_cast<Binary>(expr);
+        if (binary->get_op().type == TOKEN_DOT) {
+            collect_composition_stages(binary->get_lhs(), stages);
+            collect_composition_stages(binary->get_rhs(), stages);
+            return;
+        }
+    }
+    stages.push_back(expr);
+}
+
+static bool is_string_concat(const std::shared_ptr<Expression>& expr) {
+    if (expr->get_node_type() != AstNodeType::Binary) return false;
+    auto binary = std::static_pointer_cast<Binary>(expr);
+    return binary->get_op().type == TOKEN_PLUS && binary->get_type()->get_base_type() == types::BaseType::STRING;
+}
+
+static void collect_concat_parts(const std::shared_ptr<Expression>& expr,
+                                 std::vector<std::shared_ptr<Expression>>& parts) {
+    if (is_string_concat(expr)) {
+        auto binary = std::static_pointer_cast<Binary>(expr);
+        collect_concat_parts(binary->get_lhs(), parts);
+        collect_concat_parts(binary->get_rhs(), parts);
+        return;
+    }
+    parts.push_back(expr);
+}
+
+ConstantFolding::ConstantFolding() { env = std::make_unique<Environment<Binding>>(nullptr); }
+
+void ConstantFolding::run(std::vector<std::shared_ptr<AstNode>>& decls) {
+    AssignmentTargets targets;
+    for (auto& decl : decls) targets.walk(decl);
+    assigned = std::move(targets.names);
+
+    fold_declarations(decls);
+}
+
+std::shared_ptr<Expression> ConstantFolding::fold(const std::shared_ptr<Expression>& expr) {
+    /* The visit methods only set result if they replace the expression. */
+    result = nullptr;
+    expr->accept(this);
+    std::shared_ptr<Expression> folded = result ? result : expr;
+    result = nullptr;
+    return folded;
+}
+
+template <typename Container>
+void ConstantFolding::fold_declarations(Container& decls) {
+    for (auto it = decls.begin(); it != decls.end();) {
+        do_visit(*it);
+        bool is_dead = false;
+        if ((*it)->get_node_type() == AstNodeType::WhileStmt) {
+            auto condition = std::static_pointer_cast<WhileStmt>(*it)->get_condition();
+            is_dead = condition->get_node_type() == AstNodeType::Literal && !bool_value(condition);
+        }
+        if (is_dead) {
+            it = decls.erase(it);
+            num_folded++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ConstantFolding::visit_type(Type* type) {}
+
+void ConstantFolding::visit_formalparam(FormalParam* formalparam) {
+    env->set_variable(std::string(formalparam->get_name()), Binding{.fn_depth = fn_depth});
+}
+
+void ConstantFolding::visit_fndecl(FnDecl* fndecl) {
+    env->set_variable(fndecl->get_sname(), Binding{.fndecl = fndecl, .fn_depth = fn_depth});
+    if (fndecl->get_is_extern()) return;
+
+    UseNewEnv _(env.get());
+    fn_depth++;
+    for (auto& formal : fndecl->get_formals()) do_visit(formal);
+    do_visit(fndecl->get_body());
+    fn_depth--;
+}
+
+void ConstantFolding::visit_letdecl(LetDecl* letdecl) {
+    letdecl->set_initializer(fold(letdecl->get_initializer()));
+    auto initializer = letdecl->get_initializer();
+
+    Binding binding{.fn_depth = fn_depth};
+    std::string name = letdecl->get_name();
+    if (!assigned.contains(name) && !(incremental && fn_depth == 0)) {
+        std::vector<std::shared_ptr<Expression>> stages;
+        collect_composition_stages(initializer, stages);
+        if (is_literal(initializer) && initializer->get_type()->equals(letdecl->get_type().get())) {
+            binding.constant = initializer;
+        } else if (stages.size() > 1) {
+            for (auto& stage : stages) {
+                if (stage->get_node_type() != AstNodeType::Variable) break;
+                std::string stage_name = std::static_pointer_cast<Variable>(stage)->get_name();
+                if (!env->has_variable(stage_name) || !env->get_variable(stage_name).fndecl) break;
+                binding.composition.push_back(env->get_variable(stage_name).fndecl);
+            }
+            if (binding.composition.size() != stages.size()) binding.composition.clear();
+        }
+    }
+    env->set_variable(name, binding);
+}
+
+void ConstantFolding::visit_adtstmt(AdtStmt* adtstmt) {}
+
+void ConstantFolding::visit_exprstmt(ExprStmt* exprstmt) { exprstmt->set_expr(fold(exprstmt->get_expr())); }
+
+void ConstantFolding::visit_returnstmt(ReturnStmt* returnstmt) {
+    returnstmt->set_expr(fold(returnstmt->get_expr()));
+}
+
+void ConstantFolding::visit_whilestmt(WhileStmt* whilestmt) {
+    whilestmt->set_condition(fold(whilestmt->get_condition()));
+    do_visit(whilestmt->get_body());
+}
+
+void ConstantFolding::visit_block(Block* block) {
+    UseNewEnv _(env.get());
+    auto declarations = block->get_declarations();
+    fold_declarations(declarations);
+    block->set_declarations(declarations);
+}
+
+void ConstantFolding::visit_assignment(Assignment* assignment) {
+    /* The target stays a variable or an index expression */
+    auto target = assignment->get_target();
+    if (target->get_node_type() == AstNodeType::Index) do_visit(target);
+    assignment->set_expr(fold(assignment->get_expr()));
+}
+
+void ConstantFolding::visit_binary(Binary* binary) {
+    const Token& op = binary->get_op();
+    if (op.type == TOKEN_PLUS && binary->get_type()->get_base_type() == types::BaseType::STRING) {
+        result = concat_strings(binary);
+        return;
+    }
+
+    binary->set_lhs(fold(binary->get_lhs()));
+    binary->set_rhs(fold(binary->get_rhs()));
+    auto lhs = binary->get_lhs();
+    auto rhs = binary->get_rhs();
+
+    /* No implicit conversions between int and float here */
+    auto lhs_type = lhs->get_type()->get_base_type();
+    if (lhs->get_node_type() != rhs->get_node_type() || lhs_type != rhs->get_type()->get_base_type()) return;
+
+    std::shared_ptr<Expression> folded;
+    if (lhs->get_node_type() == AstNodeType::Number && lhs_type == types::BaseType::INT) {
+        folded = fold_int(op, int_value(lhs), int_value(rhs));
+    } else if (lhs->get_node_type() == AstNodeType::Number && lhs_type == types::BaseType::FLOAT) {
+        folded = fold_float(op, float_value(lhs), float_value(rhs));
+    } else if (lhs->get_node_type() == AstNodeType::Literal) {
+        folded = fold_bool(op, bool_value(lhs), bool_value(rhs));
+    }
+    if (folded) {
+        result = folded;
+        num_folded++;
+    }
+}
+
+std::shared_ptr<Expression> ConstantFolding::concat_strings(Binary* binary) {
+    /*
+    Concatenation is associative, adjacent literals are joined even if the
+    chain is not built from them:
+    name + "a" + "b" -> name + "ab"
+    */
+    std::vector<std::shared_ptr<Expression>> parts;
+    collect_concat_parts(binary->get_lhs(), parts);
+    collect_concat_parts(binary->get_rhs(), parts);
+
+    std::vector<std::shared_ptr<Expression>> joined;
+    for (auto& part : parts) {
+        auto folded = fold(part);
+        if (!joined.empty() && folded->get_node_type() == AstNodeType::String &&
+            joined.back()->get_node_type() == AstNodeType::String) {
+            const Token& at = std::static_pointer_cast<String>(joined.back())->get_value();
+            joined.back() = make_string(at, string_value(joined.back()) + string_value(folded));
+            num_folded++;
+        } else {
+            joined.push_back(folded);
+        }
+    }
+
+    std::shared_ptr<Expression> chain = joined.front();
+    for (size_t i = 1; i < joined.size(); ++i) {
+        chain = std::make_shared<Binary>(binary->get_op(), chain, joined[i]);
+        chain->set_type(binary->get_type());
+    }
+    return chain;
+}
+
+void ConstantFolding::visit_unary(Unary* unary) {
+    unary->set_operand(fold(unary->get_operand()));
+    auto operand = unary->get_operand();
+    const Token& op = unary->get_op();
+
+    std::shared_ptr<Expression> folded;
+    if (op.type == TOKEN_BANG && operand->get_node_type() == AstNodeType::Literal) {
+        folded = make_bool(op, !bool_value(operand));
+    } else if (op.type == TOKEN_MINUS && operand->get_node_type() == AstNodeType::Number) {
+        if (operand->get_type()->get_base_type() == types::BaseType::INT) {
+            folded = make_int(op, static_cast<int64_t>(0 - static_cast<uint64_t>(int_value(operand))));
+        } else {
+            folded = make_float(op, -float_value(operand));
+        }
+    }
+    if (folded) {
+        result = folded;
+        num_folded++;
+    }
+}
+
+void ConstantFolding::visit_variable(Variable* variable) {
+    std::string name = variable->get_name();
+    if (!env->has_variable(name)) return;
+    auto& constant = env->get_variable(name).constant;
+    if (constant) {
+        result = constant;
+        num_folded++;
+    }
+}
+
+void ConstantFolding::visit_literal(Literal* literal) {}
+
+void ConstantFolding::visit_string(String* string) {}
+
+void ConstantFolding::visit_number(Number* number) {}
+
+void ConstantFolding::visit_call(Call* call) {
+    std::list<std::shared_ptr<Expression>> arguments;
+    for (auto& argument : call->get_arguments()) arguments.push_back(fold(argument));
+    call->set_arguments(arguments);
+
+    auto applied = apply_composition(call);
+    if (applied) {
+        result = applied;
+        num_folded++;
+    }
+}
+
+std::shared_ptr<Expression> ConstantFolding::apply_composition(Call* call) {
+    /*
+    For this code:
+    let h = f . g;
+    h(x);
+
+    Call the stages directly, f(g(x)), instead of going through the crt_fn of
+    the composition. Only in the function h is bound in, the stages may be
+    closures that other functions would have to capture.
+    */
+    std::string name = call->get_fname();
+    if (call->get_is_partial() || call->get_arguments().size() != 1 || !env->has_variable(name)) return nullptr;
+    Binding& binding = env->get_variable(name);
+    if (binding.composition.empty() || binding.fn_depth != fn_depth) return nullptr;
+    for (FnDecl* stage : binding.composition) {
+        /* Some name in between may shadow a stage */
+        if (!env->has_variable(stage->get_sname()) || env->get_variable(stage->get_sname()).fndecl != stage) {
+            return nullptr;
+        }
+    }
+
+    std::shared_ptr<Expression> applied = call->get_arguments().front();
+    for (auto stage = binding.composition.rbegin(); stage != binding.composition.rend(); ++stage) {
+        auto stage_call = std::make_shared<Call>((*stage)->get_name(), std::list<std::shared_ptr<Expression>>{applied});
+        stage_call->set_type(std::static_pointer_cast<types::Fn>((*stage)->get_type())->get_ret());
+        applied = stage_call;
+    }
+    return applied;
+}
+
+void ConstantFolding::visit_placeholder(Placeholder* placeholder) {}
+
+void ConstantFolding::visit_arrayliteral(ArrayLiteral* arrayliteral) {
+    std::list<std::shared_ptr<Expression>> elements;
+    for (auto& element : arrayliteral->get_elements()) elements.push_back(fold(element));
+    arrayliteral->set_elements(elements);
+}
+
+void ConstantFolding::visit_arrayrepeat(ArrayRepeat* arrayrepeat) {
+    arrayrepeat->set_value(fold(arrayrepeat->get_value()));
+    arrayrepeat->set_count(fold(arrayrepeat->get_count()));
+}
+
+void ConstantFolding::visit_index(Index* index) {
+    index->set_array(fold(index->get_array()));
+    index->set_index(fold(index->get_index()));
+}
+
+void ConstantFolding::visit_matcharm(MatchArm* matcharm) { matcharm->set_result(fold(matcharm->get_result())); }
+
+void ConstantFolding::visit_match(Match* match) {
+    match->set_matchee(fold(match->get_matchee()));
+    for (auto& arm : match->get_arms()) do_visit(arm);
+}
@@ -0,0 +1,106 @@
+#include "carl/ast/escape_analysis.h"
+
+using namespace carl;
+
+EscapeAnalysis::EscapeAnalysis() { env = std::make_unique<Environment<FnDecl*>>(nullptr); }
+
+void EscapeAnalysis::run(const std::vector<std::shared_ptr<AstNode>>& decls) {
+    for (auto& decl : decls) do_visit(decl);
+}
+
+void EscapeAnalysis::visit_type(Type* type) {}
+
+void EscapeAnalysis::visit_formalparam(FormalParam* formalparam) {
+    env->set_variable(std::string(formalparam->get_name()), nullptr);
+}
+
+void EscapeAnalysis::visit_fndecl(FnDecl* fndecl) {
+    env->set_variable(fndecl->get_sname(), fndecl);
+    fndecl->set_escapes(false);
+    if (fndecl->get_is_extern()) return;
+
+    UseNewEnv _(env.get());
+    for (auto& formal : fndecl->get_formals()) do_visit(formal);
+    do_visit(fndecl->get_body());
+}
+
+void EscapeAnalysis::visit_letdecl(LetDecl* letdecl) {
+    do_visit(letdecl->get_initializer());
+    env->set_variable(letdecl->get_name(), nullptr);
+}
+
+void EscapeAnalysis::visit_adtstmt(AdtStmt* adtstmt) {}
+
+void EscapeAnalysis::visit_exprstmt(ExprStmt* exprstmt) { do_visit(exprstmt->get_expr()); }
+
+void EscapeAnalysis::visit_returnstmt(ReturnStmt* returnstmt) { do_visit(returnstmt->get_expr()); }
+
+void EscapeAnalysis::visit_whilestmt(WhileStmt* whilestmt) {
+    do_visit(whilestmt->get_condition());
+    do_visit(whilestmt->get_body());
+}
+
+void EscapeAnalysis::visit_block(Block* block) {
+    UseNewEnv _(env.get());
+    for (auto& decl : block->get_declarations()) do_visit(decl);
+}
+
+void EscapeAnalysis::visit_assignment(Assignment* assignment) {
+    do_visit(assignment->get_target());
+    do_visit(assignment->get_expr());
+}
+
+void EscapeAnalysis::visit_binary(Binary* binary) {
+    do_visit(binary->get_lhs());
+    do_visit(binary->get_rhs());
+}
+
+void EscapeAnalysis::visit_unary(Unary* unary) { do_visit(unary->get_operand()); }
+
+void EscapeAnalysis::visit_variable(Variable* variable) {
+    /* The closure is used as a value, it may outlive this scope. */
+    std::string name = variable->get_name();
+    if (!env->has_variable(name)) return;
+    FnDecl* fndecl = env->get_variable(name);
+    if (fndecl) fndecl->set_escapes(true);
+}
+
+void EscapeAnalysis::visit_literal(Literal* literal) {}
+
+void EscapeAnalysis::visit_string(String* string) {}
+
+void EscapeAnalysis::visit_number(Number* number) {}
+
+void EscapeAnalysis::visit_call(Call* call) {
+    /* The partially applied closure keeps a reference to the callee if it
+     * has captures. */
+    std::string name = call->get_fname();
+    if (call->get_is_partial() && env->has_variable(name)) {
+        FnDecl* fndecl = env->get_variable(name);
+        if (fndecl && !fndecl->get_captures().empty()) fndecl->set_escapes(true);
+    }
+    for (auto& argument : call->get_arguments()) do_visit(argument);
+}
+
+void EscapeAnalysis::visit_placeholder(Placeholder* placeholder) {}
+
+void EscapeAnalysis::visit_arrayliteral(ArrayLiteral* arrayliteral) {
+    for (auto& element : arrayliteral->get_elements()) do_visit(element);
+}
+
+void EscapeAnalysis::visit_arrayrepeat(ArrayRepeat* arrayrepeat) {
+    do_visit(arrayrepeat->get_value());
+    do_visit(arrayrepeat->get_count());
+}
+
+void EscapeAnalysis::visit_index(Index* index) {
+    do_visit(index->get_array());
+    do_visit(index->get_index());
+}
+
+void EscapeAnalysis::visit_matcharm(MatchArm* matcharm) { do_visit(matcharm->get_result()); }
+
+void EscapeAnalysis::visit_match(Match* match) {
+    do_visit(match->get_matchee());
+    for (auto& arm : match->get_arms()) do_visit(arm);
+}
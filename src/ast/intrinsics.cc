@@ -0,0 +1,13 @@
+#include "carl/ast/intrinsics.h"
+
+using namespace carl;
+
+Intrinsic carl::intrinsic_from_name(const std::string& name) {
+    if (name == "len") return Intrinsic::LEN;
+    if (name == "map") return Intrinsic::MAP;
+    if (name == "filter") return Intrinsic::FILTER;
+    if (name == "fold") return Intrinsic::FOLD;
+    if (name == "par_map") return Intrinsic::PAR_MAP;
+    if (name == "par_reduce") return Intrinsic::PAR_REDUCE;
+    return Intrinsic::NONE;
+}
@@ -35,6 +35,11 @@ TypeInferenceResult TypeInference::run(std::shared_ptr<AstNode> decl) {
     return TypeInferenceResult::make_result(nullptr);
 }
 
+void TypeInference::forget(const std::string& name) {
+    env->erase_variable(name);
+    fn_env->erase_variable(name);
+}
+
 void TypeInference::visit_type(Type* type) {}
 
 void TypeInference::visit_formalparam(FormalParam* formalparam) {
@@ -242,6 +247,12 @@ void TypeInference::visit_variable(Variable* variable) {
         report_error("Can not find variable or function with name " + vname);
         return;
     }
+    /* A let whose initializer did not type check, e.g. on an earlier line of
+     * the repl. */
+    if (vtype->get_base_type() == types::BaseType::UNKNOWN) {
+        report_error("Type of " + vname + " is unknown");
+        return;
+    }
     variable->set_type(vtype);
     result = vtype;
 }
@@ -265,6 +276,9 @@ void TypeInference::visit_call(Call* call) {
         callee_type = fn_env->get_variable(callee_name);
     } else if (env->has_variable(callee_name)) {
         callee_type = env->get_variable(callee_name);
+    } else if (intrinsic_from_name(callee_name) != Intrinsic::NONE) {
+        intrinsic_call(call, intrinsic_from_name(callee_name));
+        return;
     } else {
         report_error("Can not find callable with name " + callee_name);
         return;
@@ -282,16 +296,164 @@ void TypeInference::visit_call(Call* call) {
     }
 
     std::vector<std::shared_ptr<types::Type>> arg_types;
+    // a call with _ arguments is a fn taking the missing arguments
+    std::vector<std::shared_ptr<types::Type>> missing_types;
+    size_t arg_idx = 0;
     for (auto& arg : call->get_arguments()) {
+        if (arg->get_node_type() == AstNodeType::Placeholder && arg_idx < fn_type->get_parameters().size()) {
+            arg->set_type(fn_type->get_parameters().at(arg_idx));
+            missing_types.push_back(arg->get_type());
+        }
         do_visit(arg);
         arg_types.push_back(arg->get_type());
+        arg_idx++;
     }
 
     if (!fn_type->can_apply_to(arg_types)) {
         report_error("Arguments are not of the expected type for " + fn_type->str() + ".");
     }
 
-    call->set_type(fn_type->get_ret());
+    if (call->get_is_partial()) {
+        call->set_type(std::make_shared<types::Fn>(missing_types, fn_type->get_ret()));
+    } else {
+        call->set_type(fn_type->get_ret());
+    }
+    result = call->get_type();
+}
+
+void TypeInference::visit_placeholder(Placeholder* placeholder) {
+    result = placeholder->get_type();
+}
+
+
+void TypeInference::intrinsic_call(Call* call, Intrinsic intrinsic) {
+    std::vector<std::shared_ptr<types::Type>> arg_types;
+    for (auto& arg : call->get_arguments()) arg_types.push_back(do_visit(arg));
+    if (call->get_is_partial()) {
+        report_error("Can not partially apply " + std::string(call->get_fname()) + ".", call->get_fname());
+        return;
+    }
+
+    switch (intrinsic) {
+        case Intrinsic::LEN:
+            // len(a: [T]): int
+            if (arg_types.size() != 1 || arg_types[0]->get_base_type() != types::BaseType::ARRAY) {
+                report_error("len expects one array argument.", call->get_fname());
+                return;
+            }
+            call->set_type(std::make_shared<types::Int>());
+            break;
+        case Intrinsic::MAP:
+        case Intrinsic::FILTER:
+        case Intrinsic::FOLD:
+        case Intrinsic::PAR_MAP:
+        case Intrinsic::PAR_REDUCE: {
+            // map(f: (T : U), a: [T]): [U]
+            // filter(p: (T : bool), a: [T]): [T]
+            // fold(f: (A, T : A), init: A, a: [T]): A
+            // par_map like map, par_reduce(f: (T, T : T), init: T, a: [T]): T
+            bool has_init = intrinsic == Intrinsic::FOLD || intrinsic == Intrinsic::PAR_REDUCE;
+            size_t num_args = has_init ? 3 : 2;
+            std::string fname = call->get_fname();
+            if (arg_types.size() != num_args || arg_types.front()->get_base_type() != types::BaseType::FN ||
+                arg_types.back()->get_base_type() != types::BaseType::ARRAY) {
+                report_error(fname + " expects a function and an array.", call->get_fname());
+                return;
+            }
+            auto fn_type = std::static_pointer_cast<types::Fn>(arg_types.front());
+            auto element_type = std::static_pointer_cast<types::Array>(arg_types.back())->get_element();
+            auto ret_type = fn_type->get_ret();
+
+            std::vector<std::shared_ptr<types::Type>> applied_types = {element_type};
+            if (has_init) applied_types.insert(applied_types.begin(), arg_types[1]);
+            // the elements are passed as they are, no conversions
+            auto params = fn_type->get_parameters();
+            bool applies = params.size() == applied_types.size();
+            for (size_t i = 0; applies && i < params.size(); ++i) applies = params[i]->equals(applied_types[i].get());
+            if (!applies) {
+                report_error("Can not " + fname + " " + fn_type->str() + " over " + arg_types.back()->str() + ".",
+                             call->get_fname());
+                return;
+            }
+
+            if (intrinsic == Intrinsic::PAR_REDUCE && !arg_types[1]->equals(element_type.get())) {
+                // partial results are combined with f as well
+                report_error("par_reduce needs an init value of the element type " + element_type->str() + ".",
+                             call->get_fname());
+                return;
+            }
+
+            if (intrinsic == Intrinsic::MAP || intrinsic == Intrinsic::PAR_MAP) {
+                if (ret_type->get_base_type() == types::BaseType::VOID) {
+                    report_error(fname + " needs a function returning a value.", call->get_fname());
+                    return;
+                }
+                call->set_type(std::make_shared<types::Array>(ret_type));
+            } else if (intrinsic == Intrinsic::FILTER) {
+                if (ret_type->get_base_type() != types::BaseType::BOOL) {
+                    report_error("filter needs a function returning bool.", call->get_fname());
+                    return;
+                }
+                call->set_type(arg_types.back());
+            } else {
+                if (!ret_type->equals(arg_types[1].get())) {
+                    report_error(
+                        fname + " needs a function returning " + arg_types[1]->str() + " like its init value.",
+                        call->get_fname());
+                    return;
+                }
+                call->set_type(ret_type);
+            }
+            break;
+        }
+        case Intrinsic::NONE:
+            break;
+    }
     result = call->get_type();
 }
 
+void TypeInference::visit_arrayliteral(ArrayLiteral* arrayliteral) {
+    std::shared_ptr<types::Type> element_type;
+    for (auto& element : arrayliteral->get_elements()) {
+        auto type = do_visit(element);
+        if (!element_type) {
+            element_type = type;
+        } else if (!element_type->equals(type.get())) {
+            report_error("Array elements have different types " + element_type->str() + " and " + type->str() + ".",
+                         arrayliteral->get_bracket());
+            return;
+        }
+    }
+    arrayliteral->set_type(std::make_shared<types::Array>(element_type));
+    result = arrayliteral->get_type();
+}
+
+void TypeInference::visit_arrayrepeat(ArrayRepeat* arrayrepeat) {
+    auto element_type = do_visit(arrayrepeat->get_value());
+    auto count_type = do_visit(arrayrepeat->get_count());
+    if (count_type->get_base_type() != types::BaseType::INT) {
+        report_error("Array length should be int but is " + count_type->str() + ".", arrayrepeat->get_bracket());
+        return;
+    }
+    if (element_type->get_base_type() == types::BaseType::VOID) {
+        report_error("Invalid array element type " + element_type->str() + ".", arrayrepeat->get_bracket());
+        return;
+    }
+    arrayrepeat->set_type(std::make_shared<types::Array>(element_type));
+    result = arrayrepeat->get_type();
+}
+
+void TypeInference::visit_index(Index* index) {
+    auto array_type = do_visit(index->get_array());
+    auto index_type = do_visit(index->get_index());
+    if (array_type->get_base_type() != types::BaseType::ARRAY) {
+        report_error("Can only index arrays but this is " + array_type->str() + ".", index->get_bracket());
+        return;
+    }
+    if (index_type->get_base_type() != types::BaseType::INT) {
+        report_error("Index should be int but is " + index_type->str() + ".", index->get_bracket());
+        return;
+    }
+    index->set_type(std::static_pointer_cast<types::Array>(array_type)->get_element());
+    result = index->get_type();
+}
@@ -95,6 +95,21 @@ std::string Fn::str() const {
     return result;
 }
 
+BaseType Array::get_base_type() { return BaseType::ARRAY; }
+bool Array::is_rt_heap_obj() { return true; }
+
+bool Array::equals(Type* other) {
+    if (other->get_base_type() != BaseType::ARRAY) return false;
+    return element->equals(static_cast<Array*>(other)->element.get());
+}
+
+// the elements are stored as they are, no conversions
+bool Array::can_assign(Type* other) { return equals(other); }
+bool Array::can_cast_to(Type* other) { return equals(other); }
+
+const std::shared_ptr<Type> Array::get_element() { return element; }
+std::string Array::str() const { return "[" + element->str() + "]"; }
+
 void Adt::Constructor::add_member(std::shared_ptr<Type>&& member) {
     members.push_back(member);
 }
@@ -1,24 +1,274 @@
+#include <sys/resource.h>
+
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "carl/ast/type_inference.h"
 #include "carl/common.h"
+#include "carl/jit2/aot.h"
+#include "carl/jit2/carljit.h"
+#include "carl/jit2/codegen2.h"
+#include "carl/jit2/optimizer.h"
+#include "carl/jit2/repl.h"
+#include "carl/parser.h"
+#include "carl/scanner.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 
 using namespace carl;
 
-static void repl() {
+struct CliOptions {
+    OptLevel opt_level = OptLevel::O2;
+    /* carl build <input>: compile ahead of time instead of starting the repl. */
+    std::optional<std::string> build_input;
+    std::optional<std::string> output;
+    AotOutput aot_output = AotOutput::EXECUTABLE;
+    std::string cpu = "generic";
+    /* carl run <input>: compile with the jit and run it. */
+    std::optional<std::string> run_input;
+    bool timings = false;
+    std::optional<std::string> cache_dir;
+};
+
+static void usage() {
+    fprintf(stderr,
+            "usage: carl [-O0|-O1|-O2|-O3|-Os]\n"
+            "       carl build <file> [-o <output>] [-c|--shared] [--cpu <name>|native] [-O0|-O1|-O2|-O3|-Os]\n"
+            "       carl run <file> [--timings] [--cache-dir <dir>] [-O0|-O1|-O2|-O3|-Os]\n");
+}
+
+static bool parse_args(int argc, char* argv[], CliOptions& options) {
+    int i = 1;
+    if (argc > 1 && std::string(argv[1]) == "build") {
+        if (argc < 3) return false;
+        options.build_input = argv[2];
+        i = 3;
+    } else if (argc > 1 && std::string(argv[1]) == "run") {
+        if (argc < 3) return false;
+        options.run_input = argv[2];
+        i = 3;
+    }
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("-O", 0) == 0) {
+            auto level = parse_opt_level(arg.substr(2));
+            if (!level) return false;
+            options.opt_level = *level;
+        } else if (options.build_input && arg == "-o" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (options.build_input && arg == "-c") {
+            options.aot_output = AotOutput::OBJECT;
+        } else if (options.build_input && arg == "--shared") {
+            options.aot_output = AotOutput::SHARED_LIBRARY;
+        } else if (options.build_input && arg == "--cpu" && i + 1 < argc) {
+            options.cpu = argv[++i];
+        } else if (options.run_input && arg == "--timings") {
+            options.timings = true;
+        } else if (options.run_input && arg == "--cache-dir" && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Output next to the input, e.g. jobs/sum.carl -> jobs/sum, jobs/sum.o or
+ * jobs/sum.so */
+static std::string default_output(const std::string& input, AotOutput output) {
+    llvm::SmallString<128> path(input);
+    const char* extension = output == AotOutput::OBJECT ? "o" : output == AotOutput::SHARED_LIBRARY ? "so" : "";
+    llvm::sys::path::replace_extension(path, extension);
+    /* Do not overwrite an input without extension. */
+    if (path.str() == input) path += ".out";
+    return std::string(path.str());
+}
+
+static int build(const CliOptions& options) {
+    std::ifstream file(*options.build_input);
+    if (!file) {
+        fprintf(stderr, "could not read %s\n", options.build_input->c_str());
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string src = buffer.str();
+
+    Parser parser;
+    auto decls = parser.parse_r(src, false);
+    if (!decls) {
+        fprintf(stderr, "%s: %s\n", options.build_input->c_str(), decls.get_error().message.c_str());
+        return 1;
+    }
+
+    Codegen2 codegen;
+    codegen.init(*options.build_input);
+    codegen.set_opt_level(options.opt_level);
+    codegen.set_entry_point(options.aot_output == AotOutput::EXECUTABLE);
+    auto module = codegen.generate(*decls);
+    /* Codegen printed the error, nothing is emitted for the incomplete module. */
+    if (codegen.get_has_error()) return 1;
+
+    AotOptions aot_options;
+    aot_options.opt_level = options.opt_level;
+    aot_options.output = options.aot_output;
+    aot_options.cpu = options.cpu;
+    std::string output = options.output.value_or(default_output(*options.build_input, options.aot_output));
+    if (auto err = compile_ahead_of_time(module, output, aot_options)) {
+        fprintf(stderr, "carl build: %s\n", llvm::toString(std::move(err)).c_str());
+        return 1;
+    }
+    return 0;
+}
+
+/* Wall time of the phases of carl run, printed with --timings. */
+class PhaseTimer {
+   private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point last = Clock::now();
+    std::vector<std::pair<const char*, double>> phases;
+
+   public:
+    /* Ends the phase that started with the previous lap. */
+    void lap(const char* phase) {
+        auto now = Clock::now();
+        phases.emplace_back(phase, std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+    }
+
+    void print() const {
+        double total = 0;
+        for (const auto& [phase, ms] : phases) {
+            fprintf(stderr, "%-16s %10.3f ms\n", phase, ms);
+            total += ms;
+        }
+        fprintf(stderr, "%-16s %10.3f ms\n", "total", total);
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        long peak_kb = usage.ru_maxrss / 1024;
+#else
+        long peak_kb = usage.ru_maxrss;
+#endif
+        fprintf(stderr, "%-16s %10ld KiB\n", "peak rss", peak_kb);
+    }
+};
+
+static int run(const CliOptions& options) {
+    const std::string& input = *options.run_input;
+    PhaseTimer timer;
+    /* Null terminated for the scanner, large files are mapped. */
+    auto buffer = llvm::MemoryBuffer::getFile(input, false, true);
+    if (!buffer) {
+        fprintf(stderr, "could not read %s\n", input.c_str());
+        return 1;
+    }
+    timer.lap("read");
+
+    /* Objects of other carl versions stay apart and can be deleted as a whole,
+     * the key of a module also covers the exact build. */
+    std::optional<std::string> cache_dir;
+    if (options.cache_dir) {
+        llvm::SmallString<256> path(*options.cache_dir);
+        llvm::sys::path::append(path, "carl-" CARL_VERSION);
+        cache_dir = std::string(path);
+    }
+    CarlJIT jit(CarlJITOptions{.cache_dir = cache_dir, .opt_level = options.opt_level});
+    timer.lap("jit setup");
+
+    Codegen2 codegen;
+    codegen.set_opt_level(options.opt_level);
+    codegen.set_entry_point(true);
+    codegen.set_print_ir(false);
+
+    /* A cached object skips everything up to the jit's compilation. */
+    std::string module_name = input;
+    bool cached = false;
+    if (options.cache_dir) {
+        module_name = jit.cache_key((*buffer)->getBuffer().str(), codegen);
+        cached = jit.load_cached(module_name).has_value();
+        timer.lap("cache lookup");
+    }
+
+    if (!cached) {
+        auto scanner = std::make_shared<Scanner>();
+        scanner->init((*buffer)->getBufferStart());
+        Parser parser;
+        parser.set_scanner(scanner);
+        auto decls = parser.parse();
+        if (parser.has_error) return 1;
+        timer.lap("parse");
+
+        TypeInference type_inference;
+        auto typed = type_inference.run(decls);
+        if (!typed) {
+            fprintf(stderr, "%s: %s\n", input.c_str(), typed.get_error().message.c_str());
+            return 1;
+        }
+        timer.lap("type inference");
+
+        codegen.init(module_name);
+        auto module = codegen.generate(decls);
+        /* Codegen printed the error, the incomplete module is not cached. */
+        if (codegen.get_has_error()) return 1;
+        timer.lap("codegen");
+
+        if (!jit.load_module(module)) {
+            fprintf(stderr, "%s: could not load the module\n", input.c_str());
+            return 1;
+        }
+        timer.lap("load module");
+    }
+
+    /* The jit compiles the module on the first lookup. */
+    auto entry = jit.lookup_ea("__carl_entry");
+    if (!entry) {
+        fprintf(stderr, "%s: could not compile the module\n", input.c_str());
+        return 1;
+    }
+    timer.lap("compile");
+
+    /* Prints what __carl_main returns, like executables of carl build. */
+    entry->toPtr<void()>()();
+    fflush(stdout);
+    timer.lap("run");
+
+    if (options.timings) timer.print();
+    return 0;
+}
+
+static void repl(const CliOptions& options) {
+    Repl session(options.opt_level);
     char line[1024];
     for (;;) {
         printf("> ");
+        fflush(stdout);
 
         if (!fgets(line, sizeof(line), stdin)) {
             printf("\n");
             break;
         }
 
-        // TODO do something with the line
+        session.eval(line);
     }
 }
 
 int main(int argc, char* argv[]) {
+    CliOptions options;
+    if (!parse_args(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+
+    if (options.build_input) return build(options);
+    if (options.run_input) return run(options);
+
     std::cout << "carl (version " << CARL_VERSION << ")" << std::endl;
-    repl();
+    repl(options);
 }
@@ -0,0 +1,126 @@
+#include "carl/jit2/aot.h"
+
+#include <vector>
+
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/BuiltinGCs.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace carl;
+
+llvm::Error carl::emit_object_file(Codegen2Module& module, const std::string& path, OptLevel level,
+                                   const std::string& cpu) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    // modules generated with gc use the shadow-stack strategy
+    llvm::linkAllBuiltinGCs();
+
+    // the output may run on other machines, only the host's cpu features are
+    // opt in
+    auto jtmb = cpu == "native" ? llvm::orc::JITTargetMachineBuilder::detectHost()
+                                : llvm::orc::JITTargetMachineBuilder(llvm::Triple(llvm::sys::getProcessTriple()));
+    if (!jtmb) return jtmb.takeError();
+    if (cpu != "native" && cpu != "generic") {
+        std::string error;
+        auto* target = llvm::TargetRegistry::lookupTarget(jtmb->getTargetTriple().str(), error);
+        if (!target) return llvm::createStringError(llvm::inconvertibleErrorCode(), "%s", error.c_str());
+        std::unique_ptr<llvm::MCSubtargetInfo> info(
+            target->createMCSubtargetInfo(jtmb->getTargetTriple().str(), "", ""));
+        if (!info->isCPUStringValid(cpu)) {
+            return llvm::createStringError(llvm::inconvertibleErrorCode(), "unknown cpu %s", cpu.c_str());
+        }
+    }
+    if (cpu != "native") jtmb->setCPU(cpu);
+    jtmb->setCodeGenOptLevel(codegen_opt_level(level));
+    /* Executables are linked as pie by default and shared libraries need it
+     * anyway. */
+    jtmb->setRelocationModel(llvm::Reloc::PIC_);
+    auto tm = jtmb->createTargetMachine();
+    if (!tm) return tm.takeError();
+
+    std::error_code ec;
+    llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+    if (ec) return llvm::createStringError(ec, "could not open %s", path.c_str());
+
+    bool failed = false;
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([&](llvm::Module& m) {
+        m.setDataLayout((*tm)->createDataLayout());
+        m.setTargetTriple((*tm)->getTargetTriple().str());
+
+        llvm::legacy::PassManager passes;
+        failed = (*tm)->addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile);
+        if (!failed) passes.run(m);
+    });
+    out.close();
+    if (failed) return llvm::createStringError(llvm::inconvertibleErrorCode(), "target can not emit objects");
+    if (out.has_error()) return llvm::createStringError(out.error(), "could not write %s", path.c_str());
+    return llvm::Error::success();
+}
+
+/* Where carl build finds the runtime libraries without
+ * AotOptions::runtime_dir. */
+static std::string find_runtime_dir() {
+    std::string executable = llvm::sys::fs::getMainExecutable(nullptr, nullptr);
+    if (!executable.empty()) {
+        llvm::SmallString<256> bin_dir(llvm::sys::path::parent_path(executable));
+        llvm::SmallString<256> lib_dir(bin_dir);
+        llvm::sys::path::append(lib_dir, "..", "lib");
+        for (const auto& dir : {bin_dir, lib_dir}) {
+            llvm::SmallString<256> library(dir);
+            llvm::sys::path::append(library, "libcarl-runtime.a");
+            if (llvm::sys::fs::exists(library)) return std::string(dir);
+        }
+    }
+    return CARL_RUNTIME_DIR;
+}
+
+llvm::Error carl::link_object_file(const std::string& object_path, const std::string& output_path,
+                                   const AotOptions& options) {
+    auto linker = llvm::sys::findProgramByName(options.linker);
+    if (!linker) return llvm::createStringError(linker.getError(), "%s not found", options.linker.c_str());
+
+    std::string runtime_dir = options.runtime_dir.empty() ? find_runtime_dir() : options.runtime_dir;
+    std::vector<std::string> args = {*linker, object_path, "-o", output_path, "-L" + runtime_dir};
+    if (options.output == AotOutput::SHARED_LIBRARY) {
+        args.push_back("-shared");
+    } else {
+        args.push_back("-lcarl-runtime-main");
+    }
+    args.push_back("-lcarl-runtime");
+    args.push_back("-lpthread");
+
+    std::vector<llvm::StringRef> arg_refs(args.begin(), args.end());
+    std::string error;
+    int status = llvm::sys::ExecuteAndWait(*linker, arg_refs, llvm::None, {}, 0, 0, &error);
+    if (status != 0) {
+        if (error.empty()) error = options.linker + " exited with status " + std::to_string(status);
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), "%s", error.c_str());
+    }
+    return llvm::Error::success();
+}
+
+llvm::Error carl::compile_ahead_of_time(Codegen2Module& module, const std::string& output_path,
+                                        const AotOptions& options) {
+    if (options.output == AotOutput::OBJECT) {
+        return emit_object_file(module, output_path, options.opt_level, options.cpu);
+    }
+
+    llvm::SmallString<128> object_path;
+    if (auto ec = llvm::sys::fs::createTemporaryFile("carl", "o", object_path)) {
+        return llvm::createStringError(ec, "could not create a temporary object file");
+    }
+    std::string object(object_path.str());
+    llvm::Error err = emit_object_file(module, object, options.opt_level, options.cpu);
+    if (!err) err = link_object_file(object, output_path, options);
+    llvm::sys::fs::remove(object_path);
+    return err;
+}
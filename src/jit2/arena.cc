@@ -0,0 +1,91 @@
+#include "carl/jit2/arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace carl;
+
+static thread_local Arena* CURRENT_ARENA = nullptr;
+
+/* Epochs are unique across arenas, so a thread never bumps in a chunk of a
+ * destroyed arena that happened to live at the same address. */
+static std::atomic<uint64_t> NEXT_EPOCH = 1;
+
+/* The chunk the current thread bumps in. */
+struct ThreadChunk {
+    uint64_t epoch = 0;
+    char* ptr = nullptr;
+    char* end = nullptr;
+};
+static thread_local ThreadChunk THREAD_CHUNK;
+
+static size_t align_up(size_t size) {
+    return (size + Arena::alignment - 1) & ~(Arena::alignment - 1);
+}
+
+Arena::Arena(size_t chunk_size) : chunk_size(chunk_size), epoch(NEXT_EPOCH++) {}
+
+void* Arena::allocate(size_t size) {
+    size = align_up(size == 0 ? 1 : size);
+    ThreadChunk& chunk = THREAD_CHUNK;
+    if (chunk.epoch != epoch.load(std::memory_order_relaxed) || static_cast<size_t>(chunk.end - chunk.ptr) < size) {
+        next_chunk(size);
+    }
+
+    void* memory = chunk.ptr;
+    chunk.ptr += size;
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+    memset(memory, 0, size);
+    return memory;
+}
+
+void Arena::next_chunk(size_t min_size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    /* Reuse chunks kept from before the last reset if they are big enough. */
+    while (next < chunks.size() && chunks[next].size < min_size) {
+        next++;
+    }
+
+    if (next >= chunks.size()) {
+        size_t size = std::max(chunk_size, min_size);
+        chunks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        next = chunks.size() - 1;
+    }
+
+    Chunk& chunk = chunks[next++];
+    THREAD_CHUNK = {epoch.load(std::memory_order_relaxed), chunk.memory.get(), chunk.memory.get() + chunk.size};
+    bytes_reserved.fetch_add(chunk.size, std::memory_order_relaxed);
+}
+
+ArenaStats Arena::get_stats() const {
+    return {num_allocations.load(std::memory_order_relaxed), bytes_allocated.load(std::memory_order_relaxed),
+            bytes_reserved.load(std::memory_order_relaxed)};
+}
+
+void Arena::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    next = 0;
+    epoch = NEXT_EPOCH++;
+    num_allocations = 0;
+    bytes_allocated = 0;
+    bytes_reserved = 0;
+}
+
+void Arena::release() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks.clear();
+    }
+    reset();
+}
+
+Arena* carl::get_current_arena() { return CURRENT_ARENA; }
+
+void carl::set_current_arena(Arena* arena) { CURRENT_ARENA = arena; }
+
+ArenaScope::ArenaScope(Arena* arena) : previous(get_current_arena()) {
+    set_current_arena(arena);
+}
+
+ArenaScope::~ArenaScope() { set_current_arena(previous); }
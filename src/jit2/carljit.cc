@@ -2,7 +2,16 @@
 
 #include "carl/jit2/runtime.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/BuiltinGCs.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 
 using namespace carl;
 
@@ -10,27 +19,167 @@ static CarlJIT* CURRENT_JIT_PTR = nullptr;
 
 extern "C" {
     void carl_debug(uint64_t data) {
+        /* Also called from the workers of par_map */
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
         if (CURRENT_JIT_PTR) CURRENT_JIT_PTR->debug_values.push_back(data);
         return;
     }
+
+    void crt_tier_up(uint64_t id, void** slot) {
+        if (CURRENT_JIT_PTR) CURRENT_JIT_PTR->request_tier_up(id, slot);
+    }
+}
+
+/* Splits tsm into at most num_parts modules (one per function if there are
+ * fewer functions). Every part gets its own context, modules that share a
+ * context can not be compiled concurrently. */
+static std::vector<llvm::orc::ThreadSafeModule> split_module(llvm::orc::ThreadSafeModule tsm, unsigned num_parts) {
+    std::vector<llvm::orc::ThreadSafeModule> parts;
+    bool failed = false;
+    tsm.withModuleDo([&](llvm::Module& module) {
+        unsigned num_functions = 0;
+        for (auto& fn : module) num_functions += !fn.isDeclaration();
+        num_parts = std::min(num_parts, num_functions);
+        if (num_parts < 2) return;
+
+        llvm::SplitModule(module, num_parts, [&](std::unique_ptr<llvm::Module> part) {
+            llvm::SmallVector<char, 0> bitcode;
+            llvm::raw_svector_ostream os(bitcode);
+            llvm::WriteBitcodeToFile(*part, os);
+
+            auto part_context = std::make_unique<llvm::LLVMContext>();
+            llvm::StringRef buffer(bitcode.data(), bitcode.size());
+            auto parsed = llvm::parseBitcodeFile(llvm::MemoryBufferRef(buffer, part->getModuleIdentifier()),
+                                                 *part_context);
+            if (!parsed) {
+                llvm::consumeError(parsed.takeError());
+                failed = true;
+                return;
+            }
+            parts.emplace_back(std::move(*parsed), std::move(part_context));
+        });
+    });
+
+    if (parts.empty() || failed) {
+        parts.clear();
+        parts.push_back(std::move(tsm));
+    }
+    return parts;
 }
 
-CarlJIT::CarlJIT() {
-    llvm::orc::LLJITBuilder builder;
+CarlJIT::CarlJIT(CarlJITOptions options) : options(options) {
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
+    // makes the shadow-stack gc strategy available to the backend
+    llvm::linkAllBuiltinGCs();
 
-    lljit = exitErr(llvm::orc::LLJITBuilder().create());
+    if (options.cache_dir && (options.lazy || options.tiered)) {
+        fprintf(stderr, "carl: the object cache does not work with %s compilation, not using %s\n",
+                options.lazy ? "lazy" : "tiered", options.cache_dir->c_str());
+    } else if (options.cache_dir) {
+        object_cache = std::make_unique<CarlObjectCache>(*options.cache_dir);
+    }
+
+    // settings shared by the eager and the lazy jit
+    auto configure = [this](auto& builder) {
+        // host cpu with all of its features, tier 0 has to be fast to compile,
+        // the hot functions get optimized later
+        auto jtmb = exitErr(llvm::orc::JITTargetMachineBuilder::detectHost());
+        jtmb.setCodeGenOptLevel(this->options.tiered ? llvm::CodeGenOpt::None
+                                                     : codegen_opt_level(this->options.opt_level));
+        builder.setJITTargetMachineBuilder(std::move(jtmb));
+        builder.setNumCompileThreads(this->options.compile_threads);
+        if (object_cache) {
+            builder.setCompileFunctionCreator(
+                [this](llvm::orc::JITTargetMachineBuilder jtmb)
+                    -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                    // one target machine can not be used by several threads
+                    if (this->options.compile_threads > 0) {
+                        return std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(jtmb), object_cache.get());
+                    }
+                    auto tm = jtmb.createTargetMachine();
+                    if (!tm) return tm.takeError();
+                    return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(std::move(*tm), object_cache.get());
+                });
+        }
+    };
+
+    if (options.lazy) {
+        llvm::orc::LLLazyJITBuilder builder;
+        configure(builder);
+        auto lazy_jit = exitErr(builder.create());
+        // only compile the functions that are actually called, every other
+        // function is reached through a stub that compiles it on first call
+        lazy_jit->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+        lljit = std::move(lazy_jit);
+    } else {
+        llvm::orc::LLJITBuilder builder;
+        configure(builder);
+        lljit = exitErr(builder.create());
+    }
+
+    lljit->getIRTransformLayer().setTransform(
+        [this](llvm::orc::ThreadSafeModule tsm,
+               llvm::orc::MaterializationResponsibility&) -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+            tsm.withModuleDo([this](llvm::Module& m) {
+                std::lock_guard<std::mutex> lock(compiled_mutex);
+                for (auto& fn : m) {
+                    if (!fn.isDeclaration()) compiled_functions.insert(fn.getName().str());
+                }
+            });
+            return std::move(tsm);
+        });
+
+    if (options.tiered) {
+        tiering = std::make_unique<TieredCompiler>(*lljit, options.tier_up_threshold, options.tier_up_level);
+    }
+    if (options.hot_reload) {
+        hot_reloader = std::make_unique<HotReloader>(*lljit);
+    }
 
     // register mandatory external functions:
     // register_host_function("__malloc", (void*)my_malloc);
     register_host_function("__debug", (void*)carl_debug);
     register_host_function("crt_malloc", (void*)crt_malloc);
+    register_host_function("crt_malloc_traced", (void*)crt_malloc_traced);
+    register_host_function("crt_gc_safepoint", (void*)crt_gc_safepoint);
     register_host_function("crt_string__concat", (void*)crt_string__concat);
+    register_host_function("crt_string__concat_n", (void*)crt_string__concat_n);
+    register_host_function("crt_string__append_n", (void*)crt_string__append_n);
+    register_host_function("crt_array__new", (void*)crt_array__new);
+    register_host_function("crt_array__length_error", (void*)crt_array__length_error);
+    register_host_function("crt_array__index_error", (void*)crt_array__index_error);
+    register_host_function("crt_tier_up", (void*)crt_tier_up);
+    register_host_function("crt_par_map", (void*)crt_par_map);
+    register_host_function("crt_par_reduce", (void*)crt_par_reduce);
+    register_host_function("crt_print_int", (void*)crt_print_int);
+    register_host_function("crt_print_bool", (void*)crt_print_bool);
+    register_host_function("crt_print_float", (void*)crt_print_float);
+    register_host_function("crt_print_string", (void*)crt_print_string);
+    // the runtime bitcode copies strings with llvm.memcpy, which can become
+    // a library call
+    register_host_function("memcpy", (void*)memcpy);
+    register_host_function("memset", (void*)memset);
 
     // not sure if this is such a great idea but somehow the functions above
     // need access
     CURRENT_JIT_PTR = this;
+    set_thread_pool_getter([]() -> ThreadPool& { return CURRENT_JIT_PTR->get_thread_pool(); });
+    set_current_arena(&heap);
+    if (options.gc) {
+        gc_heap = std::make_unique<GcHeap>();
+        set_current_gc_heap(gc_heap.get());
+    }
+}
+
+CarlJIT::~CarlJIT() {
+    if (CURRENT_JIT_PTR == this) {
+        CURRENT_JIT_PTR = nullptr;
+        set_thread_pool_getter(nullptr);
+    }
+    if (get_current_arena() == &heap) set_current_arena(nullptr);
+    if (gc_heap && get_current_gc_heap() == gc_heap.get()) set_current_gc_heap(nullptr);
 }
 
 void CarlJIT::register_host_function(const char* name, void *addr) {
@@ -60,17 +209,89 @@ void CarlJIT::write_outs(const char* s) {
 
 std::optional<llvm::orc::ResourceTrackerSP> CarlJIT::load_module(Codegen2Module &module) {
     auto tracker = lljit->getMainJITDylib().createResourceTracker();
-    auto err = lljit->addIRModule(tracker, module.take_llvm_module());
-    if (!err) {
-        return tracker;
+    auto tsm = module.take_llvm_module();
+    if (tiering) {
+        tsm.withModuleDo([this](llvm::Module& m) { tiering->instrument(m); });
+    }
+
+    llvm::Error err = llvm::Error::success();
+    if (options.lazy) {
+        tsm.withModuleDo([this](llvm::Module& m) {
+            if (m.getDataLayout().isDefault()) m.setDataLayout(lljit->getDataLayout());
+        });
+        auto& lazy_jit = static_cast<llvm::orc::LLLazyJIT&>(*lljit);
+        err = lazy_jit.getCompileOnDemandLayer().add(tracker, std::move(tsm));
+    } else if (options.compile_threads > 0 && !object_cache) {
+        // the cache stores whole modules, so it only works without splitting
+        for (auto& part : split_module(std::move(tsm), options.compile_threads)) {
+            err = lljit->addIRModule(tracker, std::move(part));
+            if (err) break;
+        }
     } else {
+        err = lljit->addIRModule(tracker, std::move(tsm));
+    }
+    if (err) {
+        llvm::consumeError(std::move(err));
         return std::nullopt;
     }
+
+    attach_gc_root_chain();
+    return tracker;
+}
+
+std::optional<HotReloadStats> CarlJIT::reload_module(Codegen2Module& module) {
+    if (!hot_reloader) return std::nullopt;
+    auto stats = hot_reloader->load(module.take_llvm_module());
+    if (!stats) {
+        llvm::consumeError(stats.takeError());
+        return std::nullopt;
+    }
+
+    attach_gc_root_chain();
+    return *stats;
+}
+
+std::string CarlJIT::cache_key(const std::string& source, const Codegen2& codegen) const {
+    std::string flags;
+    if (options.gc) flags += "gc;";
+    flags += std::string(opt_level_name(options.opt_level)) + ";";
+    flags += codegen.get_cache_flags();
+    return CarlObjectCache::make_key(source, flags);
+}
+
+bool CarlJIT::is_compiled(const std::string& function) {
+    std::lock_guard<std::mutex> lock(compiled_mutex);
+    return compiled_functions.count(function);
+}
+
+std::optional<llvm::orc::ResourceTrackerSP> CarlJIT::load_cached(const std::string& key) {
+    if (!object_cache) return std::nullopt;
+    auto object = object_cache->get_object(key);
+    if (!object) return std::nullopt;
+
+    auto tracker = lljit->getMainJITDylib().createResourceTracker();
+    auto err = lljit->addObjectFile(tracker, std::move(object));
+    if (err) {
+        llvm::consumeError(std::move(err));
+        return std::nullopt;
+    }
+
+    attach_gc_root_chain();
+    return tracker;
+}
+
+void CarlJIT::attach_gc_root_chain() {
+    if (!gc_heap) return;
+    // llvm emits the shadow stack head into every module with gc roots,
+    // they are all merged into one definition (linkonce).
+    auto root_chain = lookup_ea("llvm_gc_root_chain");
+    if (root_chain) gc_heap->set_root_chain(root_chain->toPtr<void*>());
 }
 
 std::optional<llvm::orc::ExecutorAddr> CarlJIT::lookup_ea(const char* name) {
     auto ea = lljit->lookup(name);
     if (!ea) {
+        llvm::consumeError(ea.takeError());
         return {};
     } else {
         return ea.get();
@@ -80,8 +301,60 @@ std::optional<llvm::orc::ExecutorAddr> CarlJIT::lookup_ea(const char* name) {
 std::optional<void*> CarlJIT::lookup(const char* name) {
     auto ea = lljit->lookup(name);
     if (!ea) {
+        llvm::consumeError(ea.takeError());
         return nullptr;
     } else {
         return ea.get().toPtr<void*>();
     }
 }
+
+Arena& CarlJIT::get_heap() { return heap; }
+
+ArenaStats CarlJIT::get_heap_stats() const { return heap.get_stats(); }
+
+ArenaStats CarlJIT::reset_heap() {
+    ArenaStats stats = heap.get_stats();
+    heap.reset();
+    return stats;
+}
+
+ArenaStats CarlJIT::release_heap() {
+    ArenaStats stats = heap.get_stats();
+    heap.release();
+    return stats;
+}
+
+GcHeap* CarlJIT::get_gc_heap() { return gc_heap.get(); }
+
+void CarlJIT::collect_garbage() {
+    if (gc_heap) gc_heap->collect();
+}
+
+GcStats CarlJIT::get_gc_stats() const {
+    if (gc_heap) return gc_heap->get_stats();
+    return {};
+}
+
+void CarlJIT::request_tier_up(uint64_t id, void** slot) {
+    if (tiering) tiering->request(id, slot);
+}
+
+void CarlJIT::wait_for_tier_ups() {
+    if (tiering) tiering->wait_idle();
+}
+
+TieringStats CarlJIT::get_tiering_stats() const {
+    if (tiering) return tiering->get_stats();
+    return {};
+}
+
+ThreadPool& CarlJIT::get_thread_pool() {
+    std::call_once(thread_pool_started,
+                   [this] { thread_pool = std::make_unique<ThreadPool>(options.parallel_threads); });
+    return *thread_pool;
+}
+
+ThreadPoolStats CarlJIT::get_thread_pool_stats() const {
+    if (thread_pool) return thread_pool->get_stats();
+    return {};
+}
@@ -1,15 +1,34 @@
 #include "carl/jit2/codegen2.h"
 
+#include <set>
+
+#include "carl/ast/constant_folding.h"
+#include "carl/ast/escape_analysis.h"
+#include "carl/jit2/runtime_bitcode.h"
 #include "carl/jit2/runtime_types.h"
 #include "carl/jit2/runtime_types_llvm.h"
-#include "llvm/IR/LegacyPassManager.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 using namespace carl;
 
-Codegen2::Codegen2() {}
+Codegen2::Codegen2() {
+    auto host = create_host_target_machine(opt_level);
+    if (host) {
+        target_machine = std::move(*host);
+    } else {
+        /* Still works, just without target specific optimizations. */
+        llvm::consumeError(host.takeError());
+    }
+}
+
+void Codegen2::set_opt_level(OptLevel level) {
+    opt_level = level;
+    /* The target machine was created at the default level. */
+    if (target_machine) target_machine->setOptLevel(codegen_opt_level(level));
+}
 
 void Codegen2::init(std::string module_name) {
     has_error = false;
@@ -18,39 +37,116 @@ void Codegen2::init(std::string module_name) {
         module.release();
         builder.release();
     }
+    string_literals.clear();
+    static_closures.clear();
     context = std::make_unique<llvm::LLVMContext>();
     module = std::make_unique<llvm::Module>(module_name, *context);
+    if (target_machine) {
+        module->setDataLayout(target_machine->createDataLayout());
+        module->setTargetTriple(target_machine->getTargetTriple().str());
+    }
     builder = std::make_unique<llvm::IRBuilder<>>(*context);
 }
 
+std::string Codegen2::get_cache_flags() const {
+    std::string flags;
+    if (gc) flags += "gc;";
+    flags += std::string(opt_level_name(opt_level)) + ";";
+    if (entry_point) flags += "entry_point;";
+    if (hot_reload) flags += "hot_reload;";
+    if (incremental) flags += "incremental;";
+    if (print_ir) flags += "print_ir;";
+    if (tiered) flags += "tiered;";
+    flags += "runtime_bitcode " + runtime_bitcode_hash() + ";";
+    return flags;
+}
+
 Codegen2Module Codegen2::generate(std::vector<std::shared_ptr<AstNode>> decls) {
-    /* Init main wrapper function */
+    ConstantFolding constant_folding;
+    constant_folding.set_incremental(incremental);
+    constant_folding.run(decls);
+    EscapeAnalysis escape_analysis;
+    escape_analysis.run(decls);
+
+    /* Init main wrapper function, it returns what the top level return
+     * statements return. */
     llvm::Type* ret_type = llvm::Type::getVoidTy(*context);
-    llvm::Function* main = start_function("__carl_main", ret_type);
+    std::optional<types::BaseType> ret_base_type;
+    for (const auto& d : decls) {
+        if (d->get_node_type() == AstNodeType::ReturnStmt) {
+            auto type = std::static_pointer_cast<ReturnStmt>(d)->get_expr()->get_type();
+            ret_base_type = type->get_base_type();
+            ret_type = runtime_type_llvm_get__from_BaseType(*ret_base_type, *context);
+            break;
+        }
+    }
+    std::string main_name = "__carl_main";
+    std::string entry_name = "__carl_entry";
+    if (incremental) {
+        line++;
+        main_name += "." + std::to_string(line);
+        entry_name += "." + std::to_string(line);
+        /* Values of earlier lines belong to their modules. */
+        named_values = Environment<Value>();
+        line_globals.clear();
+    }
+    llvm::Function* main = start_function(main_name.c_str(), ret_type);
 
     /* Generate code for everything */
     for (const auto& d : decls) {
         do_visit(d);
     }
     /* In case there is no return in the code, add one. */
-    builder->CreateRetVoid();
+    finish_function(main);
+    if (entry_point) emit_entry_point(main, entry_name, ret_base_type);
 
-    module->print(llvm::outs(), nullptr);
+    if (incremental) {
+        /* Only the definitions of the line are visible to later lines, helper
+         * functions (e.g. nested fns) would clash with the ones of other
+         * lines. */
+        std::set<std::string> exported = {main_name, entry_name};
+        for (const auto& [name, global] : line_globals) exported.insert(global.impl_symbol);
+        for (auto& fn : *module) {
+            if (!fn.isDeclaration() && !exported.count(fn.getName().str())) {
+                fn.setLinkage(llvm::GlobalValue::InternalLinkage);
+            }
+        }
+        if (!has_error) {
+            for (auto& [name, global] : line_globals) session_globals.insert_or_assign(name, global);
+        }
+    }
 
-    /* Optimize and return module */
-    llvm::legacy::FunctionPassManager fpm(module.get());
-    fpm.add(llvm::createInstructionCombiningPass());
-    fpm.add(llvm::createReassociatePass());
-    fpm.add(llvm::createGVNPass());
-    fpm.add(llvm::createCFGSimplificationPass());
-    fpm.doInitialization();
+    /* Carl code never unwinds, tell llvm so it does not have to emit cleanup
+     * code (e.g. for popping shadow stack frames). */
     for (auto& f : module->getFunctionList()) {
-        fpm.run(f);
+        f.setDoesNotThrow();
+        for (auto& bb : f) {
+            for (auto& inst : bb) {
+                if (auto* call = llvm::dyn_cast<llvm::CallInst>(&inst)) call->setDoesNotThrow();
+            }
+        }
     }
 
+    if (print_ir) module->print(llvm::outs(), nullptr);
+
+    /* Runtime helpers like string concatenation become inlinable. */
+    link_runtime_bitcode(*module);
+
+    /* Interposable definitions keep llvm from inlining the functions or
+     * deriving anything from their current bodies, HotReloader makes them
+     * external again. */
+    if (hot_reload) {
+        for (auto& fn : *module) {
+            if (!fn.isDeclaration() && !fn.hasLocalLinkage()) fn.setLinkage(llvm::GlobalValue::WeakAnyLinkage);
+        }
+    }
+
+    /* Optimize and return module */
+    optimize_module(*module, tiered ? OptLevel::O0 : opt_level, target_machine.get());
+
     auto tsm =
         llvm::orc::ThreadSafeModule(std::move(module), std::move(context));
-    return Codegen2Module(std::move(tsm));
+    return Codegen2Module(std::move(tsm), main_name, entry_name);
 }
 
 llvm::Function* Codegen2::start_function(const char* name,
@@ -60,9 +156,147 @@ llvm::Function* Codegen2::start_function(const char* name,
                                      name, *module);
     auto bb = llvm::BasicBlock::Create(*context, "entry", fn);
     builder->SetInsertPoint(bb);
+    emit_gc_prologue(fn);
     return fn;
 }
 
+void Codegen2::emit_entry_point(llvm::Function* main, const std::string& name,
+                                std::optional<types::BaseType> ret_base_type) {
+    auto fn_type = llvm::FunctionType::get(llvm::Type::getVoidTy(*context), false);
+    auto fn = llvm::Function::Create(fn_type, llvm::Function::ExternalLinkage, name, *module);
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", fn));
+    llvm::Value* ret = builder->CreateCall(main);
+
+    const char* print_name = nullptr;
+    if (ret_base_type == types::BaseType::INT) print_name = "crt_print_int";
+    if (ret_base_type == types::BaseType::BOOL) print_name = "crt_print_bool";
+    if (ret_base_type == types::BaseType::FLOAT) print_name = "crt_print_float";
+    if (ret_base_type == types::BaseType::STRING) print_name = "crt_print_string";
+    /* Functions and arrays have no printable form. */
+    if (print_name) {
+        builder->CreateCall(get_external_function(print_name, llvm::Type::getVoidTy(*context), {ret->getType()}),
+                            {ret});
+    }
+    builder->CreateRetVoid();
+}
+
+void Codegen2::finish_function(llvm::Function* fn) {
+    if (builder->GetInsertBlock()->getTerminator()) return;
+    if (fn->getReturnType()->isVoidTy()) {
+        builder->CreateRetVoid();
+    } else {
+        /* Only reachable after a return statement. */
+        builder->CreateUnreachable();
+    }
+}
+
+bool Codegen2::has_named_value(const std::string& name) {
+    return named_values.has_variable(name) || session_globals.count(name);
+}
+
+Value& Codegen2::get_named_value(const std::string& name) {
+    auto global = session_globals.find(name);
+    if (named_values.has_variable(name) || global == session_globals.end()) {
+        return named_values.get_variable(name);
+    }
+
+    /* Declared in the current scope, after it ends the next use finds the
+     * declaration in the module again. */
+    const SessionGlobal& definition = global->second;
+    auto declare_variable = [&](llvm::Type* type) {
+        llvm::GlobalVariable* variable = module->getGlobalVariable(definition.symbol);
+        if (variable) return variable;
+        return new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::ExternalLinkage, nullptr,
+                                        definition.symbol);
+    };
+    if (definition.impl_symbol.empty()) {
+        auto* type = runtime_type_llvm_get__from_BaseType(definition.type->get_base_type(), *context);
+        named_values.set_variable(name, Value(declare_variable(type)));
+        return named_values.get_variable(name);
+    }
+
+    llvm::Function* impl = module->getFunction(definition.impl_symbol);
+    if (!impl) {
+        auto* impl_type = get_impl_type(*std::static_pointer_cast<types::Fn>(definition.type));
+        impl = llvm::Function::Create(impl_type, llvm::Function::ExternalLinkage, definition.impl_symbol, *module);
+    }
+    if (definition.symbol.empty()) {
+        named_values.set_variable(name, Value(impl, false));
+    } else {
+        Value value(declare_variable(llvm::PointerType::get(*context, 0)));
+        value.fn_impl = impl;
+        value.fn_has_captures = true;
+        named_values.set_variable(name, value);
+    }
+    return named_values.get_variable(name);
+}
+
+bool Codegen2::defines_session_global() {
+    /* named_values starts over with every line. */
+    return incremental && functions.empty() && named_values.get_id() == 0;
+}
+
+llvm::GlobalVariable* Codegen2::define_session_global(const std::string& name, std::shared_ptr<types::Type> type,
+                                                      llvm::Type* llvm_type, const std::string& impl_symbol) {
+    std::string symbol = name + "." + std::to_string(line);
+    auto* global = new llvm::GlobalVariable(*module, llvm_type, false, llvm::GlobalValue::ExternalLinkage,
+                                            llvm::Constant::getNullValue(llvm_type), symbol);
+    line_globals.insert_or_assign(name, SessionGlobal{.type = type, .symbol = symbol, .impl_symbol = impl_symbol});
+    return global;
+}
+
+llvm::FunctionType* Codegen2::get_impl_type(types::Fn& fn_type) {
+    auto llvm_ret_type = runtime_type_llvm_get__from_BaseType(fn_type.get_ret()->get_base_type(), *context);
+
+    std::vector<llvm::Type*> llvm_param_types;
+    for (auto carl_param_type : fn_type.get_parameters()) {
+        llvm_param_types.push_back(runtime_type_llvm_get__from_BaseType(carl_param_type->get_base_type(), *context));
+    }
+    /* capture pointer */
+    llvm_param_types.push_back(llvm::PointerType::get(*context, 0));
+
+    return llvm::FunctionType::get(llvm_ret_type, llvm_param_types, false);
+}
+
+void Codegen2::emit_gc_prologue(llvm::Function* fn) {
+    if (!gc) return;
+    fn->setGC("shadow-stack");
+
+    /* The shadow stack lowering would create the stack head during codegen,
+     * define it here so it is part of the module interface and the jit can
+     * look it up for the collector. */
+    if (!module->getGlobalVariable("llvm_gc_root_chain")) {
+        auto* ptr_type = llvm::PointerType::get(*context, 0);
+        auto* head = new llvm::GlobalVariable(*module, ptr_type, false, llvm::GlobalValue::LinkOnceAnyLinkage,
+                                              llvm::ConstantPointerNull::get(ptr_type), "llvm_gc_root_chain");
+        llvm::appendToUsed(*module, {head});
+    }
+
+    builder->CreateCall(get_crt_gc_safepoint(), {});
+}
+
+llvm::AllocaInst* Codegen2::create_root_alloca(std::string name, llvm::Type* type) {
+    llvm::AllocaInst* alloca = create_alloca(name, type);
+    if (!gc) return alloca;
+
+    /* llvm.gcroot has to be in the entry block, right after the alloca is fine. */
+    llvm::IRBuilder<> tmp_builder(alloca->getParent(), std::next(alloca->getIterator()));
+    llvm::Function* gcroot = llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::gcroot);
+    auto* null = llvm::ConstantPointerNull::get(llvm::PointerType::get(*context, 0));
+    tmp_builder.CreateCall(gcroot, {alloca, null});
+    return alloca;
+}
+
+llvm::Value* Codegen2::root_temporary(llvm::Value* value) {
+    if (!gc) return value;
+    /* Collections only happen in safepoints at function entries, so the value
+     * just has to survive until the next call. The collector does not move
+     * objects, the ssa value stays valid. */
+    llvm::AllocaInst* root = create_root_alloca("tmp_root", value->getType());
+    builder->CreateStore(value, root);
+    return value;
+}
+
 llvm::Function* Codegen2::get_external_function(
     const char* name, llvm::Type* ret_type,
     std::vector<llvm::Type*> argument_types) {
@@ -83,18 +317,409 @@ llvm::Function* Codegen2::get_crt_malloc() {
                                  {llvm::Type::getInt64Ty(*context)});
 }
 
+llvm::Function* Codegen2::get_crt_malloc_traced() {
+    return get_external_function("crt_malloc_traced",
+                                 llvm::PointerType::get(*context, 0),
+                                 {llvm::Type::getInt64Ty(*context),
+                                  llvm::Type::getInt64Ty(*context)});
+}
+
+llvm::Function* Codegen2::get_crt_gc_safepoint() {
+    return get_external_function("crt_gc_safepoint",
+                                 llvm::Type::getVoidTy(*context), {});
+}
+
 llvm::Function* Codegen2::get_crt_string__concat() {
     llvm::Type* ptrt = CRT_LLVM_TYPE(crt_string, *context)->getPointerTo();
     return get_external_function("crt_string__concat", ptrt, {ptrt, ptrt});
 }
 
+llvm::Function* Codegen2::get_crt_string__concat_n() {
+    llvm::Type* ptrt = CRT_LLVM_TYPE(crt_string, *context)->getPointerTo();
+    return get_external_function("crt_string__concat_n", ptrt,
+                                 {llvm::Type::getInt64Ty(*context), llvm::PointerType::get(*context, 0)});
+}
+
+llvm::Function* Codegen2::get_crt_string__append_n() {
+    llvm::Type* ptrt = CRT_LLVM_TYPE(crt_string, *context)->getPointerTo();
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+    return get_external_function("crt_string__append_n", ptrt,
+                                 {ptrt, ptr_type, llvm::Type::getInt64Ty(*context), ptr_type});
+}
+
+llvm::Function* Codegen2::get_crt_array__new() {
+    llvm::Type* ptrt = CRT_LLVM_TYPE(crt_array, *context)->getPointerTo();
+    return get_external_function("crt_array__new", ptrt,
+                                 {llvm::Type::getInt64Ty(*context), llvm::Type::getInt64Ty(*context)});
+}
+
+llvm::Function* Codegen2::get_crt_array__index_error() {
+    llvm::Function* fn = get_external_function("crt_array__index_error", llvm::Type::getVoidTy(*context),
+                                               {llvm::Type::getInt64Ty(*context), llvm::Type::getInt64Ty(*context)});
+    fn->setDoesNotReturn();
+    fn->addFnAttr(llvm::Attribute::Cold);
+    return fn;
+}
+
+llvm::Function* Codegen2::get_crt_par_map() {
+    llvm::Type* ptrt = CRT_LLVM_TYPE(crt_array, *context)->getPointerTo();
+    llvm::Type* i64_type = llvm::Type::getInt64Ty(*context);
+    return get_external_function("crt_par_map", ptrt,
+                                 {CRT_LLVM_TYPE(crt_fn, *context)->getPointerTo(), ptrt, i64_type, i64_type, i64_type});
+}
+
+llvm::Function* Codegen2::get_crt_par_reduce() {
+    llvm::Type* i64_type = llvm::Type::getInt64Ty(*context);
+    return get_external_function("crt_par_reduce", i64_type,
+                                 {CRT_LLVM_TYPE(crt_fn, *context)->getPointerTo(), i64_type,
+                                  CRT_LLVM_TYPE(crt_array, *context)->getPointerTo(), i64_type});
+}
+
+static bool is_string_concat(const std::shared_ptr<Expression>& expr) {
+    if (expr->get_node_type() != AstNodeType::Binary) return false;
+    auto binary = std::static_pointer_cast<Binary>(expr);
+    return binary->get_op().type == TOKEN_PLUS &&
+           binary->get_type()->get_base_type() == types::BaseType::STRING;
+}
+
+/* Operands of a chain like a + (b + c) + d in evaluation order. */
+static void collect_concat_operands(const std::shared_ptr<Expression>& expr,
+                                    std::vector<std::shared_ptr<Expression>>& operands) {
+    if (!is_string_concat(expr)) {
+        operands.push_back(expr);
+        return;
+    }
+    auto binary = std::static_pointer_cast<Binary>(expr);
+    collect_concat_operands(binary->get_lhs(), operands);
+    collect_concat_operands(binary->get_rhs(), operands);
+}
+
+void Codegen2::concat_strings(Binary* binary) {
+    std::vector<std::shared_ptr<Expression>> operands;
+    collect_concat_operands(binary->get_lhs(), operands);
+    collect_concat_operands(binary->get_rhs(), operands);
+
+    std::vector<llvm::Value*> parts;
+    for (auto& operand : operands) parts.push_back(do_visit(operand));
+
+    if (parts.size() == 2) {
+        result = builder->CreateCall(get_crt_string__concat(), parts);
+    } else {
+        /* Size the result once instead of copying for every + */
+        result = builder->CreateCall(get_crt_string__concat_n(),
+                                     {mk_uint64(parts.size()), create_string_parts(parts)});
+    }
+    root_temporary(result);
+}
+
+llvm::Value* Codegen2::create_string_parts(const std::vector<llvm::Value*>& parts) {
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+    auto* parts_type = llvm::ArrayType::get(ptr_type, parts.size());
+    llvm::AllocaInst* parts_array = create_alloca("concat_parts", parts_type);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        auto* gep = builder->CreateGEP(parts_type, parts_array, {mk_uint32(0), mk_uint32(i)});
+        builder->CreateStore(parts[i], gep);
+    }
+    return parts_array;
+}
+
+bool Codegen2::append_to_string(Assignment* assignment, const Value& target, const std::string& name) {
+    /*
+    For this code:
+    s = s + a + b;
+
+    Do:
+    s = crt_string__append_n(s, &s_capacity, 2, [a, b]);
+
+    The capacity is only set while s holds the only reference to its string
+    (every other read of s resets it), so the helper may grow the string in
+    place. Otherwise it copies into a new buffer of twice the length, a loop
+    of appends copies every character a constant number of times.
+    */
+    if (!target.string_capacity || !is_string_concat(assignment->get_expr())) return false;
+    std::vector<std::shared_ptr<Expression>> operands;
+    collect_concat_operands(assignment->get_expr(), operands);
+    const auto& first = operands.front();
+    if (first->get_node_type() != AstNodeType::Variable ||
+        std::string(std::static_pointer_cast<Variable>(first)->get_name()) != name) {
+        return false;
+    }
+
+    /* Reads of s in the appended parts reset the capacity before it is used. */
+    std::vector<llvm::Value*> parts;
+    for (auto it = std::next(operands.begin()); it != operands.end(); ++it) parts.push_back(do_visit(*it));
+    llvm::Value* string = builder->CreateLoad(target.get_type(), target.get_value(), name);
+    result = builder->CreateCall(get_crt_string__append_n(),
+                                 {string, target.string_capacity, mk_uint64(parts.size()), create_string_parts(parts)});
+    builder->CreateStore(result, target.get_value());
+    return true;
+}
+
+Value Codegen2::create_local(llvm::AllocaInst* alloca, const std::shared_ptr<types::Type>& type) {
+    Value value(alloca);
+    if (type->get_base_type() == types::BaseType::STRING) {
+        value.string_capacity = create_alloca(alloca->getName().str() + ".capacity", llvm::Type::getInt64Ty(*context));
+        reset_string_capacity(value);
+    }
+    return value;
+}
+
+void Codegen2::reset_string_capacity(const Value& value) {
+    if (value.string_capacity) builder->CreateStore(mk_uint64(0), value.string_capacity);
+}
+
+llvm::Value* Codegen2::new_array(llvm::Value* len, bool elements_traced) {
+    llvm::Value* array = builder->CreateCall(get_crt_array__new(), {len, mk_uint64(elements_traced)}, "array");
+    root_temporary(array);
+    return array;
+}
+
+llvm::MDNode* Codegen2::get_array_tbaa(const char* name) {
+    /* Headers and elements never alias, stores to the elements do not
+     * clobber len and data and the loads can be hoisted out of loops. */
+    llvm::MDBuilder md(*context);
+    llvm::MDNode* type = md.createTBAAScalarTypeNode(std::string("crt_array ") + name, md.createTBAARoot("carl"));
+    return md.createTBAAStructTagNode(type, type, 0);
+}
+
+llvm::Value* Codegen2::load_array_field(llvm::Value* array, unsigned field, const char* name) {
+    auto* array_type = CRT_LLVM_TYPE(crt_array, *context);
+    auto* gep = builder->CreateStructGEP(array_type, array, field, std::string(name) + "_gep");
+    auto* load = builder->CreateLoad(static_cast<llvm::StructType*>(array_type)->getElementType(field), gep, name);
+    load->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa(name));
+    return load;
+}
+
+llvm::Value* Codegen2::array_element_ptr(Index* index) {
+    llvm::Value* array = do_visit(index->get_array());
+    llvm::Value* idx = do_visit(index->get_index());
+    llvm::Value* len = load_array_field(array, 0, "len");
+
+    /* Unsigned, negative indices are out of bounds as well. */
+    llvm::Function* fn = builder->GetInsertBlock()->getParent();
+    auto* ok_bb = llvm::BasicBlock::Create(*context, "index_ok", fn);
+    auto* error_bb = llvm::BasicBlock::Create(*context, "index_error", fn);
+    auto* in_bounds = builder->CreateICmpULT(idx, len, "in_bounds");
+    builder->CreateCondBr(in_bounds, ok_bb, error_bb, llvm::MDBuilder(*context).createBranchWeights(1 << 20, 1));
+
+    builder->SetInsertPoint(error_bb);
+    builder->CreateCall(get_crt_array__index_error(), {idx, len});
+    builder->CreateUnreachable();
+
+    builder->SetInsertPoint(ok_bb);
+    llvm::Value* data = load_array_field(array, 2, "data");
+    auto* element_type = runtime_type_llvm_get__from_BaseType(index->get_type()->get_base_type(), *context);
+    return builder->CreateInBoundsGEP(element_type, data, idx, "element_ptr");
+}
+
 /* ----------------- visitor functions -------------------*/
 void Codegen2::visit_exprstmt(ExprStmt* exprstmt) {
-    printf("TODO: not implemented!\n");
+    do_visit(exprstmt->get_expr());
+    result = nullptr;
+}
+
+void Codegen2::visit_whilestmt(WhileStmt* whilestmt) {
+    /*
+    preheader:  br cond
+    cond:       br c, body, exit
+    body:       ...
+                br latch
+    latch:      safepoint (with gc)
+                br cond
+    exit:
+    */
+    llvm::Function* fn = builder->GetInsertBlock()->getParent();
+    auto* cond_bb = llvm::BasicBlock::Create(*context, "while_cond", fn);
+    auto* body_bb = llvm::BasicBlock::Create(*context, "while_body", fn);
+    auto* latch_bb = llvm::BasicBlock::Create(*context, "while_latch", fn);
+    auto* exit_bb = llvm::BasicBlock::Create(*context, "while_exit", fn);
+    builder->CreateBr(cond_bb);
+
+    builder->SetInsertPoint(cond_bb);
+    llvm::Value* condition = do_visit(whilestmt->get_condition());
+    condition = builder->CreateICmpNE(condition, llvm::ConstantInt::get(condition->getType(), 0), "while_cond");
+    builder->CreateCondBr(condition, body_bb, exit_bb);
+
+    builder->SetInsertPoint(body_bb);
+    do_visit(whilestmt->get_body());
+    builder->CreateBr(latch_bb);
+
+    builder->SetInsertPoint(latch_bb);
+    /* Loops that allocate without calling anything would never collect. */
+    if (gc) builder->CreateCall(get_crt_gc_safepoint(), {});
+    builder->CreateBr(cond_bb);
+
+    builder->SetInsertPoint(exit_bb);
+    result = nullptr;
+}
+
+void Codegen2::visit_assignment(Assignment* assignment) {
+    if (assignment->get_target()->get_node_type() == AstNodeType::Index) {
+        llvm::Value* element_ptr = array_element_ptr(static_cast<Index*>(assignment->get_target().get()));
+        llvm::Value* value = do_visit(assignment->get_expr());
+        builder->CreateStore(value, element_ptr)->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("element"));
+        result = value;
+        return;
+    }
+    if (assignment->get_target()->get_node_type() != AstNodeType::Variable) {
+        error("can only assign to variables and array elements");
+        return;
+    }
+    std::string name = std::static_pointer_cast<Variable>(assignment->get_target())->get_name();
+    Value& v = get_named_value(name);
+    /* Calls of declared functions are bound statically. */
+    if (v.fn_impl) {
+        error("can not assign to a function declaration");
+        return;
+    }
+    if (append_to_string(assignment, v, name)) return;
+    llvm::Value* value = do_visit(assignment->get_expr());
+    if (value->getType() != v.get_type() && value->getType()->isFloatingPointTy()) {
+        value = builder->CreateFPCast(value, v.get_type());
+    }
+    builder->CreateStore(value, v.get_value());
+    reset_string_capacity(v);
+    result = value;
+}
+
+/* Stages of f . (g . h) in call order: h, g, f */
+static void collect_composition_stages(const std::shared_ptr<Expression>& expr,
+                                       std::vector<std::shared_ptr<Expression>>& stages) {
+    if (expr->get_node_type() == AstNodeType::Binary) {
+        auto binary = std::static_pointer_cast<Binary>(expr);
+        if (binary->get_op().type == TOKEN_DOT) {
+            collect_composition_stages(binary->get_rhs(), stages);
+            collect_composition_stages(binary->get_lhs(), stages);
+            return;
+        }
+    }
+    stages.push_back(expr);
+}
+
+void Codegen2::compose_functions(Binary* binary) {
+    /*
+    For this code:
+    let h = f . g . k;
+
+    Do:
+    1) Evaluate the stages, capture the crt_fn objects that are not
+       statically known
+    2) Generate one function calling all stages
+    function composition_impl (a : int, captures: ptr) : int {
+        return f_impl(g_impl(k_impl(a, null), null), null);
+    }
+    3) Create the crt_fn object, without captures it is a constant
+    */
+    std::vector<std::shared_ptr<Expression>> stage_exprs;
+    collect_composition_stages(binary->get_rhs(), stage_exprs);
+    collect_composition_stages(binary->get_lhs(), stage_exprs);
+
+    struct Stage {
+        /* Known implementation, called directly. */
+        llvm::Function* impl = nullptr;
+        /* crt_fn if it is a constant. */
+        llvm::Value* wrapper = nullptr;
+        /* Index into the captures, -1 if not captured. */
+        int capture_idx = -1;
+    };
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+
+    /* 1) */
+    std::vector<Stage> stages;
+    std::vector<llvm::Value*> captures;
+    std::vector<bool> traced;
+    for (const auto& expr : stage_exprs) {
+        Stage stage;
+        llvm::Value* wrapper = nullptr;
+        if (expr->get_node_type() == AstNodeType::Variable) {
+            std::string name = std::static_pointer_cast<Variable>(expr)->get_name();
+            Value& v = get_named_value(name);
+            stage.impl = v.fn_impl;
+            if (v.fn_impl && v.fn_has_captures) {
+                if (!closure_in_reach(v)) {
+                    error("can not compose a closure of an enclosing function");
+                    return;
+                }
+                wrapper = builder->CreateLoad(ptr_type, v.get_value(), name + "_wrapper");
+            } else if (!v.fn_impl) {
+                wrapper = do_visit(expr);
+            }
+        } else {
+            wrapper = do_visit(expr);
+        }
+        if (wrapper && llvm::isa<llvm::Constant>(wrapper)) {
+            stage.wrapper = wrapper;
+        } else if (wrapper) {
+            stage.capture_idx = captures.size();
+            captures.push_back(wrapper);
+            traced.push_back(true);
+        }
+        stages.push_back(stage);
+    }
+    std::vector<llvm::Type*> capture_types(captures.size(), ptr_type);
+    auto* captures_type = llvm::StructType::create(*context, capture_types, "composition_captures");
+
+    /* 2) */
+    auto composed_type = std::static_pointer_cast<types::Fn>(binary->get_type());
+    std::vector<llvm::Type*> param_types;
+    for (auto& param_type : composed_type->get_parameters()) {
+        param_types.push_back(runtime_type_llvm_get__from_BaseType(param_type->get_base_type(), *context));
+    }
+    param_types.push_back(ptr_type);
+    llvm::Function* composed_fn = llvm::Function::Create(
+        llvm::FunctionType::get(runtime_type_llvm_get__from_BaseType(composed_type->get_ret()->get_base_type(), *context),
+                                param_types, false),
+        llvm::Function::InternalLinkage, "composition_impl", *module);
+    llvm::Argument* capture_arg = composed_fn->getArg(composed_fn->arg_size() - 1);
+    capture_arg->setName("capture_ptr");
+
+    auto* old_insert_block = builder->GetInsertBlock();
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", composed_fn));
+    std::vector<llvm::Value*> arguments;
+    for (size_t arg_idx = 0; arg_idx + 1 < composed_fn->arg_size(); ++arg_idx) {
+        arguments.push_back(composed_fn->getArg(arg_idx));
+    }
+    llvm::CallInst* stage_result = nullptr;
+    for (size_t stage_idx = 0; stage_idx < stages.size(); ++stage_idx) {
+        const Stage& stage = stages[stage_idx];
+        llvm::Value* wrapper = stage.wrapper;
+        if (stage.capture_idx >= 0) {
+            auto* gep = builder->CreateStructGEP(captures_type, capture_arg, stage.capture_idx, "capture_gep");
+            wrapper = builder->CreateLoad(ptr_type, gep, "stage_wrapper");
+        }
+        auto stage_type = std::static_pointer_cast<types::Fn>(stage_exprs[stage_idx]->get_type());
+        auto* ret_type = runtime_type_llvm_get__from_BaseType(stage_type->get_ret()->get_base_type(), *context);
+        stage_result = call_closure(wrapper, stage.impl, arguments, ret_type);
+        arguments = {stage_result};
+    }
+    stage_result->setTailCall();
+    if (stage_result->getType()->isVoidTy()) {
+        builder->CreateRetVoid();
+    } else {
+        builder->CreateRet(stage_result);
+    }
+    builder->SetInsertPoint(old_insert_block);
+
+    /* 3) */
+    if (captures.empty()) {
+        result = get_static_closure(composed_fn);
+        return;
+    }
+    result = create_closure(composed_fn, captures_type, captures, traced, false);
+    root_temporary(result);
 }
 
 void Codegen2::visit_binary(Binary* binary) {
     auto op_token = binary->get_op().type;
+    if (op_token == TOKEN_DOT) {
+        compose_functions(binary);
+        return;
+    }
+    if (op_token == TOKEN_PLUS && binary->get_type()->get_base_type() == types::BaseType::STRING) {
+        concat_strings(binary);
+        return;
+    }
+
     llvm::Value* lhs = do_visit(binary->get_lhs());
     llvm::Value* rhs = nullptr;
 
@@ -179,7 +804,7 @@ void Codegen2::visit_binary(Binary* binary) {
             }
             break;
         case types::BaseType::STRING:
-            result = builder->CreateCall(get_crt_string__concat(), {lhs, rhs});
+            error("unsupported string binop found");
             break;
         case types::BaseType::BOOL:
         case types::BaseType::FN:
@@ -188,71 +813,206 @@ void Codegen2::visit_binary(Binary* binary) {
         default:
             error("Unexpected binary expr lhs type");
     }
+    /* Comparisons give i1, bools are stored, passed and captured as their
+     * runtime type. */
+    if (result && result->getType()->isIntegerTy(1)) {
+        result = builder->CreateZExt(result, runtime_type_llvm_get__from_BaseType(types::BaseType::BOOL, *context));
+    }
 }
 
 void Codegen2::visit_number(Number* number) {
+    /* The token is followed by a non digit (source or folded text) */
     switch (number->get_type()->get_base_type()) {
         case types::BaseType::INT:
-            result = llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context), atoi(number->get_value().start));
+            result = llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context),
+                                            strtoll(number->get_value().start, nullptr, 10), true);
             break;
         case types::BaseType::FLOAT:
-            result = llvm::ConstantFP::get(llvm::Type::getFloatTy(*context), (double)atof(number->get_value().start));
+            result = llvm::ConstantFP::get(runtime_type_llvm_get__from_BaseType(types::BaseType::FLOAT, *context),
+                                           strtod(number->get_value().start, nullptr));
             break;
         default:
             error("Invalid number base type encountered.");
     }
 }
 
-void Codegen2::visit_string(String* string) {
-    /* Allocate the new crt_string object. */
-    llvm::Function* fn_crt_alloc = get_crt_malloc();
-    llvm::Value* crt_string_ptr = builder->CreateCall(
-        fn_crt_alloc, mk_uint64(sizeof(crt_string)), "crt_malloc");
+void Codegen2::visit_literal(Literal* literal) {
+    /* true and false, as the runtime type of bools */
+    auto* bool_type = runtime_type_llvm_get__from_BaseType(types::BaseType::BOOL, *context);
+    result = llvm::ConstantInt::get(bool_type, literal->get_value().type == TOKEN_TRUE);
+}
 
-    /* Initialize the crt_string. */
+void Codegen2::visit_string(String* string) {
+    /* Literals are immutable, so every evaluation can share one constant
+     * crt_string. This needs copy on write once strings can be mutated. */
     std::string std_string = std::string(string->get_value().start + 1,
                                          string->get_value().length - 2);
-    auto string_ref = llvm::StringRef(std_string);
-    auto const_str = llvm::ConstantDataArray::getString(*context, string_ref);
-    llvm::Value* str_len = llvm::ConstantInt::get(
-        llvm::Type::getInt64Ty(*context), std_string.size() + 1, false);
-    llvm::Value* crt_string_data_ptr =
-        builder->CreateCall(fn_crt_alloc, {str_len}, "crt_malloc");
-    builder->CreateStore(const_str, crt_string_data_ptr);
-
-    /* Set fields of crt string */
-    auto* gep_len =
-        builder->CreateGEP(CRT_LLVM_TYPE(crt_string, *context), crt_string_ptr,
-                           {mk_uint32(0), mk_uint32(0)}, "crt_string_len");
-    auto* gep_data =
-        builder->CreateGEP(CRT_LLVM_TYPE(crt_string, *context), crt_string_ptr,
-                           {mk_uint32(0), mk_uint32(1)}, "crt_string_data");
-    builder->CreateStore(str_len, gep_len);
-    builder->CreateStore(crt_string_data_ptr, gep_data);
-
-    result = crt_string_ptr;
+    auto it = string_literals.find(std_string);
+    if (it != string_literals.end()) {
+        result = it->second;
+        return;
+    }
+
+    llvm::Constant* data = builder->CreateGlobalStringPtr(std_string, "str_data", 0, module.get());
+    auto* crt_string_type = static_cast<llvm::StructType*>(CRT_LLVM_TYPE(crt_string, *context));
+    auto* str_len = llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context), std_string.size() + 1, false);
+    auto* initializer = llvm::ConstantStruct::get(crt_string_type, {str_len, data});
+    auto* literal = new llvm::GlobalVariable(*module, crt_string_type, true, llvm::GlobalValue::PrivateLinkage,
+                                             initializer, "str");
+    literal->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+
+    string_literals[std_string] = literal;
+    result = literal;
 }
 
 void Codegen2::visit_letdecl(LetDecl* letdecl) {
     std::string name = letdecl->get_name();
     llvm::Value* initializer = do_visit(letdecl->get_initializer());
-    llvm::AllocaInst* local = create_alloca(name, initializer->getType());
+    if (!initializer) {
+        /* The initializer reported an error, the module is not used. */
+        result = nullptr;
+        return;
+    }
+    if (defines_session_global()) {
+        auto* global = define_session_global(name, letdecl->get_type(), initializer->getType());
+        builder->CreateStore(initializer, global);
+        named_values.set_variable(name, Value(global));
+        result = nullptr;
+        return;
+    }
+    llvm::AllocaInst* local =
+        letdecl->get_type()->is_rt_heap_obj()
+            ? create_root_alloca(name, initializer->getType())
+            : create_alloca(name, initializer->getType());
     builder->CreateStore(initializer, local);
-    named_values.set_variable(name, local);
+    named_values.set_variable(name, create_local(local, letdecl->get_type()));
 
     result = nullptr;
 }
 
 void Codegen2::visit_variable(Variable* variable) {
-    Value& v = named_values.get_variable(variable->get_name());
+    Value& v = get_named_value(variable->get_name());
+    if (v.fn_impl && !v.fn_has_captures) {
+        result = get_static_closure(v.fn_impl);
+        return;
+    }
+    if (!v.get_value()) {
+        error("a function can not refer to itself as a value");
+        return;
+    }
     result = builder->CreateLoad(v.get_type(), v.get_value());
+    /* Someone else may hold the string now. */
+    reset_string_capacity(v);
 }
 
 void Codegen2::visit_returnstmt(ReturnStmt* returnstmt) {
-    builder->CreateRet(do_visit(returnstmt->get_expr()));
+    auto expr = returnstmt->get_expr();
+    if (expr->get_node_type() == AstNodeType::Call && self_tail_call(static_cast<Call*>(expr.get()))) {
+        // jumped back to the start of the function
+    } else {
+        tail_position = expr->get_node_type() == AstNodeType::Call;
+        builder->CreateRet(do_visit(expr));
+        tail_position = false;
+    }
+    /* Code after the return is dead but still needs a block. */
+    auto* dead = llvm::BasicBlock::Create(*context, "after_return",
+                                          builder->GetInsertBlock()->getParent());
+    builder->SetInsertPoint(dead);
     result = nullptr;
 }
 
+llvm::Constant* Codegen2::get_static_closure(llvm::Function* impl) {
+    auto it = static_closures.find(impl);
+    if (it != static_closures.end()) return it->second;
+
+    auto* crt_fn_type = static_cast<llvm::StructType*>(CRT_LLVM_TYPE(crt_fn, *context));
+    auto* null = llvm::ConstantPointerNull::get(llvm::PointerType::get(*context, 0));
+    auto* initializer = llvm::ConstantStruct::get(crt_fn_type, {impl, null});
+    std::string name = impl->getName().str();
+    name = name.substr(0, name.rfind("_impl"));
+    auto* closure = new llvm::GlobalVariable(*module, crt_fn_type, true, llvm::GlobalValue::PrivateLinkage,
+                                             initializer, name);
+    closure->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    static_closures[impl] = closure;
+    return closure;
+}
+
+std::list<std::shared_ptr<Variable>> Codegen2::get_captures(FnDecl* fndecl) {
+    if (!defines_session_global()) return fndecl->get_captures();
+
+    std::list<std::shared_ptr<Variable>> captures;
+    for (const auto& capture : fndecl->get_captures()) {
+        const std::string& name = capture->get_name();
+        if (has_named_value(name) && get_named_value(name).is_global) continue;
+        captures.push_back(capture);
+    }
+    return captures;
+}
+
+llvm::StructType* Codegen2::get_captures_type(FnDecl* fndecl,
+                                              const std::list<std::shared_ptr<Variable>>& captures) {
+    std::vector<llvm::Type*> fields;
+    for (const auto& capture : captures) {
+        fields.push_back(runtime_type_llvm_get__from_BaseType(capture->get_type()->get_base_type(), *context));
+    }
+    return llvm::StructType::create(*context, fields, fndecl->get_sname() + "_captures");
+}
+
+llvm::Value* Codegen2::create_closure(llvm::Function* impl, llvm::StructType* captures_type,
+                                      const std::vector<llvm::Value*>& captures, const std::vector<bool>& traced,
+                                      bool on_stack) {
+    auto* fn_llvm_type = CRT_LLVM_TYPE(crt_fn, *context);
+    auto* closure_type = llvm::StructType::get(*context, {fn_llvm_type, captures_type});
+
+    // tell the gc which words hold references, the captures pointer points
+    // into the object itself and does not need to be traced
+    const llvm::DataLayout& data_layout = module->getDataLayout();
+    const llvm::StructLayout* captures_layout = data_layout.getStructLayout(captures_type);
+    uint64_t captures_offset = data_layout.getStructLayout(closure_type)->getElementOffset(1);
+    uint64_t ptr_mask = 0;
+    for (size_t field_idx = 0; field_idx < captures.size(); ++field_idx) {
+        if (traced[field_idx]) {
+            uint64_t word = (captures_offset + captures_layout->getElementOffset(field_idx)) / sizeof(void*);
+            ptr_mask |= word < 64 ? (uint64_t)1 << word : CRT_GC_SCAN_ALL;
+        }
+    }
+
+    llvm::Value* crt_fn_ptr = nullptr;
+    if (on_stack) {
+        crt_fn_ptr = create_alloca("crt_fn", closure_type);
+    } else {
+        crt_fn_ptr = builder->CreateCall(
+            get_crt_malloc_traced(),
+            {llvm::ConstantExpr::getSizeOf(closure_type), mk_uint64(ptr_mask)},
+            "crt_fn_ptr");
+    }
+    auto* fn_ptr =
+        builder->CreateGEP(fn_llvm_type, crt_fn_ptr,
+                           {mk_uint32(0), mk_uint32(0)}, "crt_fn_fn_ptr");
+    builder->CreateStore(impl, fn_ptr);
+
+    llvm::Value* capture_ptr = llvm::ConstantPointerNull::get(llvm::PointerType::get(*context, 0));
+    if (!captures.empty()) {
+        capture_ptr = builder->CreateConstInBoundsGEP1_64(llvm::Type::getInt8Ty(*context), crt_fn_ptr,
+                                                          captures_offset, "capture_ptr");
+    }
+    // capture values into the struct
+    for (size_t capture_idx = 0; capture_idx < captures.size(); ++capture_idx) {
+        /* The gc does not trace the stack captures, root the values. */
+        if (on_stack && traced[capture_idx]) root_temporary(captures[capture_idx]);
+        auto* capture_elem_ptr = builder->CreateStructGEP(
+            captures_type, capture_ptr, capture_idx,
+            std::string("capture_") + std::to_string(capture_idx));
+        builder->CreateStore(captures[capture_idx], capture_elem_ptr);
+    }
+    // store capture ptr into the fn wrapper struct
+    auto* fn_crt_capture_ptr =
+        builder->CreateGEP(fn_llvm_type, crt_fn_ptr,
+                           {mk_uint32(0), mk_uint32(1)}, "crt_fn_capture_ptr");
+    builder->CreateStore(capture_ptr, fn_crt_capture_ptr);
+    return crt_fn_ptr;
+}
+
 void Codegen2::visit_fndecl(FnDecl* fndecl) {
     /*
     For this code:
@@ -264,42 +1024,39 @@ void Codegen2::visit_fndecl(FnDecl* fndecl) {
     Do:
     1) Generate function code
     function foo_impl (b : int, captures: ptr) : int {
-        alloca a = captures[0];
+        alloca a = captures->a;
         return a + b;
     }
-    2) Create the crt_fn object
-    crt_fn {
+    2) Create the crt_fn object, the captures struct (one field with the real
+       type per capture) is allocated in one block with it
+    { crt_fn {
         impl_ptr = foo;
-        captures = [a = 1]; <<--- vector / array of 64 bit values
+        captures = &captures_struct;
+      },
+      foo_captures { a = 1 } <<--- captures_struct
     }
     3) Store crt_fn object in alloca with correct name
+
+    Without captures the crt_fn is a constant and 2) and 3) are skipped.
     */
 
+    std::string fname = fndecl->get_sname();
+    auto captures = get_captures(fndecl);
+    llvm::StructType* captures_type = get_captures_type(fndecl, captures);
+    bool session_definition = defines_session_global();
+
     /* 1) */
     /* Generate function if it does not exist yet */
-    std::string fname = fndecl->get_sname();
     llvm::Function* llvm_fn = module->getFunction(fname);
     if (llvm_fn == nullptr) {
         assert(fndecl->get_type()->get_base_type() == types::BaseType::FN);
 
         auto carl_fn_type =
             std::static_pointer_cast<types::Fn>(fndecl->get_type());
-
-        auto llvm_ret_type = runtime_type_llvm_get__from_BaseType(
-            carl_fn_type->get_ret()->get_base_type(), *context);
-
-        std::vector<llvm::Type*> llvm_param_types;
-        for (auto carl_param_type : carl_fn_type->get_parameters()) {
-            llvm_param_types.push_back(runtime_type_llvm_get__from_BaseType(
-                carl_param_type->get_base_type(), *context));
-        }
-        /* capture pointer */
-        llvm_param_types.push_back(llvm::PointerType::get(*context, 0));
-
-        auto llvm_fn_type =
-            llvm::FunctionType::get(llvm_ret_type, llvm_param_types, false);
+        auto llvm_fn_type = get_impl_type(*carl_fn_type);
 
         std::string fn_name = fname + "_impl";
+        if (session_definition) fn_name += "." + std::to_string(line);
         llvm_fn = llvm::Function::Create(
             llvm_fn_type, llvm::Function::ExternalLinkage, fn_name, *module);
 
@@ -316,79 +1073,107 @@ void Codegen2::visit_fndecl(FnDecl* fndecl) {
         auto* body = llvm::BasicBlock::Create(*context, "entry", llvm_fn);
         builder->SetInsertPoint(body);
         named_values.push();
+        /* Recursive calls go directly to this function. */
+        named_values.set_variable(fname, Value(llvm_fn, !captures.empty()));
 
+        FunctionContext fn_context{.fn = llvm_fn};
         size_t num_args = fndecl->get_formals().size();
         for (size_t arg_idx = 0; arg_idx < num_args; ++arg_idx) {
             llvm::Argument* v = llvm_fn->getArg(arg_idx);
             std::string name = v->getName().str();
-            llvm::AllocaInst* alloca = create_alloca(name, v->getType());
+            bool is_heap_obj = carl_fn_type->get_parameters().at(arg_idx)->is_rt_heap_obj();
+            llvm::AllocaInst* alloca = is_heap_obj ? create_root_alloca(name, v->getType())
+                                                   : create_alloca(name, v->getType());
             builder->CreateStore(v, alloca);
-            named_values.set_variable(name, Value(alloca));
+            Value formal = create_local(alloca, carl_fn_type->get_parameters().at(arg_idx));
+            named_values.set_variable(name, formal);
+            fn_context.formals.push_back(formal);
         }
         /* Load each captured value into an alloca with the correct name. */
         llvm::Argument* capture_arg = llvm_fn->getArg(num_args);
         size_t capture_idx = 0;
-        for (auto capture : fndecl->get_captures()) {
+        for (auto capture : captures) {
             auto t = runtime_type_llvm_get__from_BaseType(
                     capture->get_type()->get_base_type(), *context);
-            llvm::AllocaInst* alloca = create_alloca(capture->get_name(), t);
-            llvm::Value* capture_gep = builder->CreateGEP(llvm::Type::getInt64Ty(*context), capture_arg, {mk_uint32(capture_idx)}, "capture_gep");
+            llvm::AllocaInst* alloca = capture->get_type()->is_rt_heap_obj()
+                                           ? create_root_alloca(capture->get_name(), t)
+                                           : create_alloca(capture->get_name(), t);
+            llvm::Value* capture_gep = builder->CreateStructGEP(captures_type, capture_arg, capture_idx, "capture_gep");
             builder->CreateStore(builder->CreateLoad(t, capture_gep), alloca);
-            named_values.set_variable(capture->get_name(), Value(alloca));
+            named_values.set_variable(capture->get_name(), create_local(alloca, capture->get_type()));
 
             capture_idx++;
         }
 
+        /* Self recursive tail calls store the new arguments and jump back
+         * here. */
+        fn_context.tail_recurse = llvm::BasicBlock::Create(*context, "tail_recurse", llvm_fn);
+        builder->CreateBr(fn_context.tail_recurse);
+        builder->SetInsertPoint(fn_context.tail_recurse);
+
+        /* Arguments and captures are rooted now. */
+        emit_gc_prologue(llvm_fn);
+
         /* Generate the actual body */
+        functions.push_back(fn_context);
         do_visit(fndecl->get_body());
-        builder->CreateRetVoid();
+        functions.pop_back();
+        finish_function(llvm_fn);
 
         named_values.pop();
         builder->SetInsertPoint(old_insert_block);
     }
 
     /* 2) */
-    llvm::Function* fn_crt_alloc = get_crt_malloc();
-    auto* fn_llvm_type = CRT_LLVM_TYPE(crt_fn, *context);
-    llvm::Value* crt_fn_ptr = builder->CreateCall(
-        fn_crt_alloc, llvm::ConstantExpr::getSizeOf(fn_llvm_type),
-        "crt_fn_ptr");
-    auto* fn_ptr =
-        builder->CreateGEP(fn_llvm_type, crt_fn_ptr,
-                           {mk_uint32(0), mk_uint32(0)}, "crt_fn_fn_ptr");
-    builder->CreateStore(llvm_fn, fn_ptr);
-
-    // allocate captures vector
-    auto* capture_ptr = builder->CreateCall(
-        fn_crt_alloc,
-        mk_uint64(sizeof(uint64_t) * fndecl->get_captures().size()),
-        "capture_ptr");
-    // capture values into the vector
-    size_t capture_idx = 0;
-    for (const auto& capture : fndecl->get_captures()) {
-        auto& value = named_values.get_variable(capture->get_name());
-        auto* loaded = builder->CreateLoad(value.get_type(), value.get_value());
-        auto* capture_elem_ptr = builder->CreateGEP(
-            llvm::Type::getInt64PtrTy(*context), capture_ptr,
-            {mk_uint32(capture_idx)},
-            std::string("capture_") + std::to_string(capture_idx));
-        builder->CreateStore(loaded, capture_elem_ptr);
-
-        capture_idx++;
+    std::vector<llvm::Value*> capture_values;
+    std::vector<bool> traced;
+    for (const auto& capture : captures) {
+        auto& value = get_named_value(capture->get_name());
+        llvm::Value* loaded = builder->CreateLoad(value.get_type(), value.get_value());
+        reset_string_capacity(value);
+        llvm::Type* field_type = captures_type->getElementType(capture_values.size());
+        if (loaded->getType() != field_type && loaded->getType()->isFloatingPointTy()) {
+            loaded = builder->CreateFPCast(loaded, field_type);
+        }
+        capture_values.push_back(loaded);
+        traced.push_back(capture->get_type()->is_rt_heap_obj());
     }
-    // store capture ptr into the fn wrapper struct
-    auto* fn_crt_capture_ptr =
-        builder->CreateGEP(fn_llvm_type, crt_fn_ptr,
-                           {mk_uint32(0), mk_uint32(1)}, "crt_fn_capture_ptr");
-    builder->CreateStore(capture_ptr, fn_crt_capture_ptr);
+    if (capture_values.empty()) {
+        /* The crt_fn is a constant, see visit_variable */
+        named_values.set_variable(fndecl->get_sname(), Value(llvm_fn, false));
+        if (session_definition) {
+            line_globals.insert_or_assign(
+                fname, SessionGlobal{.type = fndecl->get_type(), .impl_symbol = llvm_fn->getName().str()});
+        }
+        result = nullptr;
+        return;
+    }
+    /* Closures that do not outlive this function live in its frame, see
+     * EscapeAnalysis. Later lines may call the ones of a session. */
+    bool on_stack = !fndecl->get_escapes() && !session_definition;
+    llvm::Value* crt_fn_ptr = create_closure(llvm_fn, captures_type, capture_values, traced, on_stack);
 
     /* 3) */
+    if (session_definition) {
+        auto* global = define_session_global(fname, fndecl->get_type(), crt_fn_ptr->getType(),
+                                             llvm_fn->getName().str());
+        builder->CreateStore(crt_fn_ptr, global);
+        Value value(global);
+        value.fn_impl = llvm_fn;
+        value.fn_has_captures = true;
+        named_values.set_variable(fname, value);
+        result = nullptr;
+        return;
+    }
     llvm::AllocaInst* fn_alloca =
-        create_alloca(fndecl->get_sname(), crt_fn_ptr->getType());
+        create_root_alloca(fndecl->get_sname(), crt_fn_ptr->getType());
     builder->CreateStore(crt_fn_ptr, fn_alloca);
     Value value(fn_alloca);
+    value.fn_impl = llvm_fn;
+    value.fn_has_captures = true;
+    value.fn_on_stack = on_stack;
     named_values.set_variable(fndecl->get_sname(), value);
-
+    result = nullptr;
 }
 
 void Codegen2::visit_block(Block* block) {
@@ -400,14 +1185,224 @@ void Codegen2::visit_block(Block* block) {
     result = nullptr;
 }
 
+bool Codegen2::closure_in_reach(const Value& v) {
+    if (v.is_global) return true;
+    return v.is_alloca && v.as_alloca()->getFunction() == builder->GetInsertBlock()->getParent();
+}
+
+llvm::Value* Codegen2::direct_call_captures(const Value& callee) {
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+    if (!callee.fn_has_captures) return llvm::ConstantPointerNull::get(ptr_type);
+
+    llvm::Function* current_fn = builder->GetInsertBlock()->getParent();
+    /* Recursion, our own captures */
+    if (callee.fn_impl == current_fn) return current_fn->getArg(current_fn->arg_size() - 1);
+    /* Declared in this function or an earlier line, the captures are in its
+     * crt_fn */
+    if (closure_in_reach(callee)) {
+        auto* fn_wrapper = builder->CreateLoad(ptr_type, callee.get_value(), "fn_wrapper");
+        auto* captures_gep = builder->CreateGEP(CRT_LLVM_TYPE(crt_fn, *context), fn_wrapper,
+                                                {mk_uint32(0), mk_uint32(1)}, "capture_gep");
+        return builder->CreateLoad(ptr_type, captures_gep, "capture_ptr");
+    }
+    return nullptr;
+}
+
+llvm::CallInst* Codegen2::call_closure(llvm::Value* wrapper, llvm::Function* impl,
+                                       std::vector<llvm::Value*> arguments, llvm::Type* ret_type) {
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+    llvm::Value* captures = llvm::ConstantPointerNull::get(ptr_type);
+    if (wrapper) {
+        auto* captures_gep = builder->CreateGEP(CRT_LLVM_TYPE(crt_fn, *context), wrapper,
+                                                {mk_uint32(0), mk_uint32(1)}, "capture_gep");
+        captures = builder->CreateLoad(ptr_type, captures_gep, "capture_ptr");
+    }
+    arguments.push_back(captures);
+    if (impl) return builder->CreateCall(impl, arguments);
+
+    auto* impl_gep = builder->CreateGEP(CRT_LLVM_TYPE(crt_fn, *context), wrapper,
+                                        {mk_uint32(0), mk_uint32(0)}, "fn_ptr_gep");
+    auto* impl_ptr = builder->CreateLoad(ptr_type, impl_gep, "impl_ptr");
+    std::vector<llvm::Type*> arg_types;
+    for (auto* argument : arguments) arg_types.push_back(argument->getType());
+    return builder->CreateCall(llvm::FunctionType::get(ret_type, arg_types, false), impl_ptr, arguments);
+}
+
+/* Arguments that can be generated into a specialised function instead of
+ * being captured. */
+static bool is_constant_argument(const std::shared_ptr<Expression>& expr) {
+    return expr->get_node_type() == AstNodeType::Number || expr->get_node_type() == AstNodeType::String;
+}
+
+void Codegen2::partial_application(Call* call) {
+    /*
+    For this code:
+    fn add(a: int, b: int): int {
+        return a + b;
+    }
+    let add_two = add(_, 2);
+
+    Do:
+    1) Generate a function specialised for the bound arguments, constants are
+       generated into it, everything else is captured
+    function add_partial_impl (a : int, captures: ptr) : int {
+        return add_impl(a, 2, null);
+    }
+    2) Create the crt_fn object like for a fn declaration, without captures
+       it is a constant
+    */
+    std::string fname = call->get_fname();
+    Value& callee = get_named_value(fname);
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+
+    /* Statically known functions are called directly, anything else and
+     * closures with captures need their crt_fn. */
+    bool capture_callee = !callee.fn_impl || callee.fn_has_captures;
+    if (capture_callee && !closure_in_reach(callee)) {
+        error("can not partially apply a closure of an enclosing function");
+        return;
+    }
+
+    std::vector<llvm::Value*> captures;
+    std::vector<bool> traced;
+    if (capture_callee) {
+        captures.push_back(builder->CreateLoad(ptr_type, callee.get_value(), fname + "_wrapper"));
+        traced.push_back(true);
+    }
+    std::vector<llvm::Type*> param_types;
+    for (const auto& arg : call->get_arguments()) {
+        if (arg->get_node_type() == AstNodeType::Placeholder) {
+            param_types.push_back(runtime_type_llvm_get__from_BaseType(arg->get_type()->get_base_type(), *context));
+        } else if (!is_constant_argument(arg)) {
+            captures.push_back(do_visit(arg));
+            traced.push_back(arg->get_type()->is_rt_heap_obj());
+        }
+    }
+    std::vector<llvm::Type*> capture_types;
+    for (auto* capture : captures) capture_types.push_back(capture->getType());
+    auto* captures_type = llvm::StructType::create(*context, capture_types, fname + "_partial_captures");
+
+    /* 1) */
+    auto partial_type = std::static_pointer_cast<types::Fn>(call->get_type());
+    auto* ret_type = runtime_type_llvm_get__from_BaseType(partial_type->get_ret()->get_base_type(), *context);
+    param_types.push_back(ptr_type);
+    llvm::Function* partial_fn =
+        llvm::Function::Create(llvm::FunctionType::get(ret_type, param_types, false),
+                               llvm::Function::InternalLinkage, fname + "_partial_impl", *module);
+    llvm::Argument* capture_arg = partial_fn->getArg(partial_fn->arg_size() - 1);
+    capture_arg->setName("capture_ptr");
+
+    auto* old_insert_block = builder->GetInsertBlock();
+    builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "entry", partial_fn));
+    unsigned field_idx = 0;
+    auto load_capture = [&]() {
+        auto* gep = builder->CreateStructGEP(captures_type, capture_arg, field_idx, "capture_gep");
+        return builder->CreateLoad(capture_types[field_idx++], gep);
+    };
+    llvm::Value* callee_wrapper = capture_callee ? load_capture() : nullptr;
+    std::vector<llvm::Value*> arguments;
+    unsigned param_idx = 0;
+    for (const auto& arg : call->get_arguments()) {
+        if (arg->get_node_type() == AstNodeType::Placeholder) {
+            arguments.push_back(partial_fn->getArg(param_idx++));
+        } else if (is_constant_argument(arg)) {
+            arguments.push_back(do_visit(arg));
+        } else {
+            arguments.push_back(load_capture());
+        }
+    }
+
+    llvm::CallInst* forward = call_closure(callee_wrapper, callee.fn_impl, arguments, ret_type);
+    forward->setTailCall();
+    if (ret_type->isVoidTy()) {
+        builder->CreateRetVoid();
+    } else {
+        builder->CreateRet(forward);
+    }
+    builder->SetInsertPoint(old_insert_block);
+
+    /* 2) */
+    if (captures.empty()) {
+        result = get_static_closure(partial_fn);
+        return;
+    }
+    result = create_closure(partial_fn, captures_type, captures, traced, false);
+    root_temporary(result);
+}
+
+bool Codegen2::self_tail_call(Call* call) {
+    if (call->get_is_partial() || functions.empty()) return false;
+    if (!has_named_value(call->get_fname())) return false;
+    const FunctionContext& fn_context = functions.back();
+    Value& v = get_named_value(call->get_fname());
+    if (v.fn_impl != fn_context.fn || builder->GetInsertBlock()->getParent() != fn_context.fn) return false;
+
+    /* Evaluate all arguments before the formals are overwritten. */
+    std::vector<llvm::Value*> arguments;
+    for (const auto& arg : call->get_arguments()) arguments.push_back(do_visit(arg));
+    for (size_t arg_idx = 0; arg_idx < arguments.size(); ++arg_idx) {
+        builder->CreateStore(arguments[arg_idx], fn_context.formals[arg_idx].get_value());
+        reset_string_capacity(fn_context.formals[arg_idx]);
+    }
+    builder->CreateBr(fn_context.tail_recurse);
+    return true;
+}
+
+void Codegen2::mark_tail_call(llvm::CallInst* call, const Value& callee) {
+    /* Captures of closures on the stack live in our frame. */
+    if (callee.fn_on_stack) return;
+    for (auto& arg : call->args()) {
+        if (llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(arg))) return;
+    }
+    /* Guaranteed if the prototypes match, otherwise up to the backend. */
+    llvm::Function* current_fn = builder->GetInsertBlock()->getParent();
+    if (call->getFunctionType() == current_fn->getFunctionType()) {
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    } else {
+        call->setTailCall();
+    }
+}
+
 void Codegen2::visit_call(Call* call) {
-    Value& v = named_values.get_variable(call->get_fname());
+    bool is_tail = tail_position;
+    tail_position = false;
+    if (call->get_is_partial()) {
+        partial_application(call);
+        return;
+    }
+    if (!has_named_value(call->get_fname())) {
+        intrinsic_call(call, intrinsic_from_name(call->get_fname()));
+        return;
+    }
+    Value& v = get_named_value(call->get_fname());
+
+    /* Statically known callee, call the implementation directly so llvm can
+     * inline it. */
+    llvm::Value* direct_captures = v.fn_impl ? direct_call_captures(v) : nullptr;
+    if (direct_captures) {
+        std::vector<llvm::Value*> arguments;
+        for (const auto& arg : call->get_arguments()) {
+            arguments.push_back(do_visit(arg));
+        }
+        arguments.push_back(direct_captures);
+        auto* direct_call = builder->CreateCall(v.fn_impl, arguments, std::string(call->get_fname()));
+        result = direct_call;
+        if (is_tail) {
+            mark_tail_call(direct_call, v);
+        } else if (call->get_type()->is_rt_heap_obj()) {
+            root_temporary(result);
+        }
+        return;
+    }
+
     auto* fn_wrapper =
         builder->CreateLoad(v.get_type(), v.get_value(),
                             std::string(call->get_fname()) + "_wrapper");
-    llvm::outs() << "fn_wrapper type: ";
-    fn_wrapper->getType()->print(llvm::outs());
-    llvm::outs() << "\n";
+    if (print_ir) {
+        llvm::outs() << "fn_wrapper type: ";
+        fn_wrapper->getType()->print(llvm::outs());
+        llvm::outs() << "\n";
+    }
     auto* fn_wrapper_fn_ptr_gep =
         builder->CreateGEP(CRT_LLVM_TYPE(crt_fn, *context), fn_wrapper,
                            {mk_uint32(0), mk_uint32(0)}, "fn_ptr_gep");
@@ -424,13 +1419,318 @@ void Codegen2::visit_call(Call* call) {
     auto* fn_wrapper_cap_gep =
         builder->CreateGEP(CRT_LLVM_TYPE(crt_fn, *context), fn_wrapper,
                            {mk_uint32(0), mk_uint32(1)}, "capture_gep");
-    auto* fn_wrapper_cap_ptr = builder->CreateLoad(llvm::Type::getInt64PtrTy(*context), fn_wrapper_cap_gep, "capture_ptr");
+    auto* fn_wrapper_cap_ptr = builder->CreateLoad(llvm::PointerType::get(*context, 0), fn_wrapper_cap_gep, "capture_ptr");
     arguments.push_back(fn_wrapper_cap_ptr);
 
     auto* ret_type = runtime_type_llvm_get__from_BaseType(
         call->get_type()->get_base_type(), *context);
     llvm::FunctionType* fn_type =
         llvm::FunctionType::get(ret_type, arg_types, false);
-    result = builder->CreateCall(fn_type, fn_impl_ptr, arguments,
-                                 std::string(call->get_fname()));
+    auto* indirect_call = builder->CreateCall(fn_type, fn_impl_ptr, arguments,
+                                              std::string(call->get_fname()));
+    result = indirect_call;
+    if (is_tail) {
+        mark_tail_call(indirect_call, v);
+    } else if (call->get_type()->is_rt_heap_obj()) {
+        root_temporary(result);
+    }
+}
+
+void Codegen2::intrinsic_call(Call* call, Intrinsic intrinsic) {
+    switch (intrinsic) {
+        case Intrinsic::LEN:
+            result = load_array_field(do_visit(call->get_arguments().front()), 0, "len");
+            return;
+        case Intrinsic::MAP:
+        case Intrinsic::FILTER:
+        case Intrinsic::FOLD:
+            array_pipeline(call);
+            return;
+        case Intrinsic::PAR_MAP:
+        case Intrinsic::PAR_REDUCE:
+            parallel_call(call, intrinsic);
+            return;
+        case Intrinsic::NONE:
+            break;
+    }
+    error("unknown intrinsic");
+}
+
+/* map or filter call whose result can be consumed element by element. */
+bool Codegen2::is_array_stage(const std::shared_ptr<Expression>& expr) {
+    if (expr->get_node_type() != AstNodeType::Call) return false;
+    auto call = std::static_pointer_cast<Call>(expr);
+    std::string fname = call->get_fname();
+    if (has_named_value(fname)) return false;
+    Intrinsic intrinsic = intrinsic_from_name(fname);
+    return intrinsic == Intrinsic::MAP || intrinsic == Intrinsic::FILTER;
+}
+
+void Codegen2::array_pipeline(Call* call) {
+    /*
+    For this code:
+    let total = fold(add, 0, map(square, filter(is_even, numbers)));
+
+    Do one loop over the source array, no intermediate arrays:
+    acc = 0
+    for (i = 0; i < len(numbers); ++i) {
+        x = numbers[i]
+        if (!is_even(x)) continue;
+        x = square(x)
+        acc = add(acc, x)
+    }
+    With map or filter as the outermost call the loop stores into a new
+    array instead, it has the length of the source as capacity.
+
+    Known functions are called directly (and inlined), anything else through
+    its crt_fn.
+    */
+    struct Stage {
+        Intrinsic kind;
+        llvm::Function* impl = nullptr;
+        /* crt_fn, needed for the captures or an indirect call. */
+        llvm::Value* wrapper = nullptr;
+        llvm::Type* ret_type;
+    };
+    auto* ptr_type = llvm::PointerType::get(*context, 0);
+    llvm::Function* current_fn = builder->GetInsertBlock()->getParent();
+
+    /* Outermost stage first, the arguments are evaluated in this order. */
+    std::vector<Stage> stages;
+    llvm::Value* init = nullptr;
+    Call* stage_call = call;
+    std::shared_ptr<Expression> source;
+    for (;;) {
+        const auto& arguments = stage_call->get_arguments();
+        const auto& fn_expr = arguments.front();
+        Stage stage{.kind = intrinsic_from_name(stage_call->get_fname())};
+        auto fn_type = std::static_pointer_cast<types::Fn>(fn_expr->get_type());
+        stage.ret_type = runtime_type_llvm_get__from_BaseType(fn_type->get_ret()->get_base_type(), *context);
+
+        if (fn_expr->get_node_type() == AstNodeType::Variable &&
+            get_named_value(std::static_pointer_cast<Variable>(fn_expr)->get_name()).fn_impl) {
+            std::string name = std::static_pointer_cast<Variable>(fn_expr)->get_name();
+            Value& v = get_named_value(name);
+            stage.impl = v.fn_impl;
+            if (v.fn_has_captures) {
+                if (!closure_in_reach(v)) {
+                    error("can not pass a closure of an enclosing function to an array function");
+                    return;
+                }
+                stage.wrapper = builder->CreateLoad(ptr_type, v.get_value(), name + "_wrapper");
+            }
+        } else {
+            stage.wrapper = do_visit(fn_expr);
+        }
+        if (stage.kind == Intrinsic::FOLD) init = do_visit(*std::next(arguments.begin()));
+        stages.push_back(stage);
+
+        if (!is_array_stage(arguments.back())) {
+            source = arguments.back();
+            break;
+        }
+        stage_call = static_cast<Call*>(arguments.back().get());
+    }
+    llvm::Value* source_array = do_visit(source);
+    if (has_error) return;
+
+    auto source_type = std::static_pointer_cast<types::Array>(source->get_type());
+    auto* element_type = runtime_type_llvm_get__from_BaseType(source_type->get_element()->get_base_type(), *context);
+    auto* i64_type = llvm::Type::getInt64Ty(*context);
+    llvm::Value* len = load_array_field(source_array, 0, "len");
+    llvm::Value* source_data = load_array_field(source_array, 2, "data");
+
+    /* Consumer: a new array or the accumulator of a fold */
+    Intrinsic consumer = stages.front().kind;
+    llvm::Value* out_array = nullptr;
+    llvm::Value* out_data = nullptr;
+    llvm::AllocaInst* out_len = nullptr;
+    llvm::AllocaInst* acc = nullptr;
+    if (consumer == Intrinsic::FOLD) {
+        acc = call->get_type()->is_rt_heap_obj() ? create_root_alloca("acc", init->getType())
+                                                 : create_alloca("acc", init->getType());
+        builder->CreateStore(init, acc);
+    } else {
+        auto out_type = std::static_pointer_cast<types::Array>(call->get_type());
+        out_array = new_array(len, out_type->get_element()->is_rt_heap_obj());
+        out_data = load_array_field(out_array, 2, "data");
+        out_len = create_alloca("out_len", i64_type);
+        builder->CreateStore(mk_uint64(0), out_len);
+    }
+
+    llvm::AllocaInst* i = create_alloca("i", i64_type);
+    builder->CreateStore(mk_uint64(0), i);
+    auto* cond_bb = llvm::BasicBlock::Create(*context, "pipeline_cond", current_fn);
+    auto* body_bb = llvm::BasicBlock::Create(*context, "pipeline_body", current_fn);
+    auto* latch_bb = llvm::BasicBlock::Create(*context, "pipeline_latch", current_fn);
+    auto* exit_bb = llvm::BasicBlock::Create(*context, "pipeline_exit", current_fn);
+    builder->CreateBr(cond_bb);
+
+    builder->SetInsertPoint(cond_bb);
+    llvm::Value* idx = builder->CreateLoad(i64_type, i, "idx");
+    builder->CreateCondBr(builder->CreateICmpULT(idx, len), body_bb, exit_bb);
+
+    builder->SetInsertPoint(body_bb);
+    auto* element = builder->CreateLoad(element_type, builder->CreateInBoundsGEP(element_type, source_data, idx),
+                                        "element");
+    element->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("element"));
+    llvm::Value* x = element;
+    for (auto stage = stages.rbegin(); stage != stages.rend(); ++stage) {
+        switch (stage->kind) {
+            case Intrinsic::MAP:
+                /* x is only passed on to the next call (which roots its
+                 * arguments) or stored into the rooted result array. */
+                x = call_closure(stage->wrapper, stage->impl, {x}, stage->ret_type);
+                break;
+            case Intrinsic::FILTER: {
+                llvm::Value* keep = call_closure(stage->wrapper, stage->impl, {x}, stage->ret_type);
+                auto* keep_bb = llvm::BasicBlock::Create(*context, "pipeline_keep", current_fn, latch_bb);
+                builder->CreateCondBr(builder->CreateICmpNE(keep, llvm::ConstantInt::get(keep->getType(), 0)),
+                                      keep_bb, latch_bb);
+                builder->SetInsertPoint(keep_bb);
+                break;
+            }
+            case Intrinsic::FOLD: {
+                llvm::Value* acc_value = builder->CreateLoad(acc->getAllocatedType(), acc, "acc_value");
+                builder->CreateStore(call_closure(stage->wrapper, stage->impl, {acc_value, x}, stage->ret_type), acc);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (out_array) {
+        llvm::Value* out_idx = builder->CreateLoad(i64_type, out_len, "out_idx");
+        builder->CreateStore(x, builder->CreateInBoundsGEP(x->getType(), out_data, out_idx))
+            ->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("element"));
+        builder->CreateStore(builder->CreateNUWAdd(out_idx, mk_uint64(1)), out_len);
+    }
+    builder->CreateBr(latch_bb);
+
+    builder->SetInsertPoint(latch_bb);
+    builder->CreateStore(builder->CreateNUWAdd(idx, mk_uint64(1)), i);
+    builder->CreateBr(cond_bb);
+
+    builder->SetInsertPoint(exit_bb);
+    if (acc) {
+        result = builder->CreateLoad(acc->getAllocatedType(), acc, "fold");
+        if (call->get_type()->is_rt_heap_obj()) root_temporary(result);
+        return;
+    }
+    /* Filtered out elements leave the tail of the capacity unused. */
+    auto* array_type = CRT_LLVM_TYPE(crt_array, *context);
+    builder->CreateStore(builder->CreateLoad(i64_type, out_len), builder->CreateStructGEP(array_type, out_array, 0))
+        ->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("len"));
+    result = out_array;
+}
+
+void Codegen2::parallel_call(Call* call, Intrinsic intrinsic) {
+    /*
+    The worker threads call the function through its crt_fn, the runtime
+    only sees the elements as 8 byte words:
+    let squares = par_map(square, numbers);
+    ->
+    squares = crt_par_map(square_wrapper, numbers, numbers_float, squares_float, squares_traced)
+
+    Unlike array_pipeline nothing is inlined, this pays off for functions that
+    do enough work per element.
+    */
+    const auto& arguments = call->get_arguments();
+    llvm::Value* fn = do_visit(arguments.front());
+    llvm::Value* init = nullptr;
+    if (intrinsic == Intrinsic::PAR_REDUCE) init = do_visit(*std::next(arguments.begin()));
+    llvm::Value* array = do_visit(arguments.back());
+    if (has_error) return;
+
+    auto element = std::static_pointer_cast<types::Array>(arguments.back()->get_type())->get_element();
+    bool element_is_float = element->get_base_type() == types::BaseType::FLOAT;
+    if (intrinsic == Intrinsic::PAR_MAP) {
+        auto result_element = std::static_pointer_cast<types::Array>(call->get_type())->get_element();
+        result = builder->CreateCall(get_crt_par_map(),
+                                     {fn, array, mk_uint64(element_is_float),
+                                      mk_uint64(result_element->get_base_type() == types::BaseType::FLOAT),
+                                      mk_uint64(result_element->is_rt_heap_obj())},
+                                     "par_map");
+        root_temporary(result);
+        return;
+    }
+
+    auto* i64_type = llvm::Type::getInt64Ty(*context);
+    llvm::Value* init_word = init;
+    if (element_is_float) {
+        init_word = builder->CreateBitCast(init, i64_type);
+    } else if (element->is_rt_heap_obj()) {
+        init_word = builder->CreatePtrToInt(init, i64_type);
+    }
+    llvm::Value* word =
+        builder->CreateCall(get_crt_par_reduce(), {fn, init_word, array, mk_uint64(element_is_float)}, "par_reduce");
+    if (element_is_float) {
+        result = builder->CreateBitCast(word, init->getType());
+    } else if (element->is_rt_heap_obj()) {
+        result = root_temporary(builder->CreateIntToPtr(word, init->getType()));
+    } else {
+        result = word;
+    }
+}
+
+void Codegen2::visit_arrayliteral(ArrayLiteral* arrayliteral) {
+    /* Evaluate the elements first, the array is only rooted in this
+     * function. */
+    std::vector<llvm::Value*> elements;
+    for (const auto& element : arrayliteral->get_elements()) elements.push_back(do_visit(element));
+
+    auto array_type = std::static_pointer_cast<types::Array>(arrayliteral->get_type());
+    llvm::Value* array = new_array(mk_uint64(elements.size()), array_type->get_element()->is_rt_heap_obj());
+    llvm::Value* data = load_array_field(array, 2, "data");
+    for (size_t i = 0; i < elements.size(); ++i) {
+        auto* element_ptr = builder->CreateConstInBoundsGEP1_64(elements[i]->getType(), data, i, "element_ptr");
+        builder->CreateStore(elements[i], element_ptr)->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("element"));
+    }
+    result = array;
+}
+
+void Codegen2::visit_arrayrepeat(ArrayRepeat* arrayrepeat) {
+    /*
+    [value; count]:
+    array = crt_array__new(count)
+    for (i = 0; i < count; ++i) array->data[i] = value;
+
+    The array is zeroed already, the loop is skipped for zero values.
+    */
+    llvm::Value* value = do_visit(arrayrepeat->get_value());
+    llvm::Value* count = do_visit(arrayrepeat->get_count());
+    auto array_type = std::static_pointer_cast<types::Array>(arrayrepeat->get_type());
+    llvm::Value* array = new_array(count, array_type->get_element()->is_rt_heap_obj());
+    result = array;
+    if (auto* constant = llvm::dyn_cast<llvm::Constant>(value); constant && constant->isNullValue()) return;
+
+    llvm::Value* data = load_array_field(array, 2, "data");
+    llvm::Function* fn = builder->GetInsertBlock()->getParent();
+    auto* preheader_bb = builder->GetInsertBlock();
+    auto* cond_bb = llvm::BasicBlock::Create(*context, "fill_cond", fn);
+    auto* body_bb = llvm::BasicBlock::Create(*context, "fill_body", fn);
+    auto* exit_bb = llvm::BasicBlock::Create(*context, "fill_exit", fn);
+    builder->CreateBr(cond_bb);
+
+    builder->SetInsertPoint(cond_bb);
+    auto* i = builder->CreatePHI(llvm::Type::getInt64Ty(*context), 2, "i");
+    i->addIncoming(mk_uint64(0), preheader_bb);
+    builder->CreateCondBr(builder->CreateICmpULT(i, count), body_bb, exit_bb);
+
+    builder->SetInsertPoint(body_bb);
+    builder->CreateStore(value, builder->CreateInBoundsGEP(value->getType(), data, i, "element_ptr"))
+        ->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("element"));
+    i->addIncoming(builder->CreateNUWAdd(i, mk_uint64(1), "i_next"), body_bb);
+    builder->CreateBr(cond_bb);
+
+    builder->SetInsertPoint(exit_bb);
+}
+
+void Codegen2::visit_index(Index* index) {
+    llvm::Value* element_ptr = array_element_ptr(index);
+    auto* element_type = runtime_type_llvm_get__from_BaseType(index->get_type()->get_base_type(), *context);
+    auto* element = builder->CreateLoad(element_type, element_ptr, "element");
+    element->setMetadata(llvm::LLVMContext::MD_tbaa, get_array_tbaa("element"));
+    result = element;
+    if (index->get_type()->is_rt_heap_obj()) root_temporary(result);
 }
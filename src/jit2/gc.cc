@@ -0,0 +1,122 @@
+#include "carl/jit2/gc.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using namespace carl;
+
+static thread_local GcHeap* CURRENT_GC_HEAP = nullptr;
+
+static crt_gc_header* header_of(void* payload) {
+    return reinterpret_cast<crt_gc_header*>(payload) - 1;
+}
+
+static void* payload_of(crt_gc_header* header) { return header + 1; }
+
+GcHeap::GcHeap(size_t threshold) : threshold(threshold), min_threshold(threshold) {}
+
+GcHeap::~GcHeap() {
+    for (auto* object : objects) free(object);
+}
+
+void* GcHeap::allocate(size_t size, uint64_t ptr_mask) {
+    auto* header = static_cast<crt_gc_header*>(malloc(sizeof(crt_gc_header) + size));
+    memset(header, 0, sizeof(crt_gc_header) + size);
+    header->size = size;
+    header->ptr_mask = ptr_mask;
+    objects.insert(header);
+
+    bytes_since_collect += size;
+    stats.num_allocations++;
+    stats.objects_live++;
+    stats.bytes_live += size;
+    return payload_of(header);
+}
+
+void GcHeap::safepoint() {
+    if (bytes_since_collect >= threshold) collect();
+}
+
+void GcHeap::collect() {
+    /* Mark everything reachable from the shadow stack ... */
+    if (root_chain) {
+        for (StackEntry* entry = *root_chain; entry; entry = entry->next) {
+            for (int32_t i = 0; i < entry->map->num_roots; ++i) {
+                mark(entry->roots[i]);
+            }
+        }
+    }
+    /* ... and from the host. */
+    for (void** slot : host_roots) mark(*slot);
+
+    while (!mark_stack.empty()) {
+        crt_gc_header* object = mark_stack.back();
+        mark_stack.pop_back();
+        trace(object);
+    }
+
+    sweep();
+
+    stats.num_collections++;
+    bytes_since_collect = 0;
+    threshold = std::max(min_threshold, static_cast<size_t>(stats.bytes_live));
+}
+
+void GcHeap::mark(void* ptr) {
+    if (ptr == nullptr) return;
+    /* Values can also point to constants or host memory, only trace our own
+     * objects. */
+    crt_gc_header* header = header_of(ptr);
+    if (!objects.contains(header) || header->marked) return;
+    header->marked = 1;
+    mark_stack.push_back(header);
+}
+
+void GcHeap::trace(crt_gc_header* object) {
+    if (object->ptr_mask == 0) return;
+
+    auto** words = static_cast<void**>(payload_of(object));
+    size_t num_words = object->size / sizeof(void*);
+    if (object->ptr_mask != CRT_GC_SCAN_ALL) {
+        num_words = std::min<size_t>(num_words, 64);
+    }
+    for (size_t i = 0; i < num_words; ++i) {
+        if (object->ptr_mask == CRT_GC_SCAN_ALL || (object->ptr_mask >> i) & 1) {
+            mark(words[i]);
+        }
+    }
+}
+
+void GcHeap::sweep() {
+    for (auto it = objects.begin(); it != objects.end();) {
+        crt_gc_header* object = *it;
+        if (object->marked) {
+            object->marked = 0;
+            ++it;
+            continue;
+        }
+        stats.objects_live--;
+        stats.bytes_live -= object->size;
+        stats.objects_freed++;
+        stats.bytes_freed += object->size;
+        it = objects.erase(it);
+        free(object);
+    }
+}
+
+void GcHeap::add_root(void** slot) { host_roots.push_back(slot); }
+
+void GcHeap::remove_root(void** slot) {
+    auto it = std::find(host_roots.begin(), host_roots.end(), slot);
+    if (it != host_roots.end()) host_roots.erase(it);
+}
+
+void GcHeap::set_threshold(size_t bytes) {
+    threshold = bytes;
+    min_threshold = bytes;
+}
+
+GcHeap* carl::get_current_gc_heap() { return CURRENT_GC_HEAP; }
+
+void carl::set_current_gc_heap(GcHeap* heap) { CURRENT_GC_HEAP = heap; }
@@ -0,0 +1,173 @@
+#include "carl/jit2/hot_reload.h"
+
+#include <vector>
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace carl;
+
+/* Module with fn and private copies of the constants and module local
+ * functions it uses, every other function and global is declared. */
+static std::unique_ptr<llvm::Module> split_function(const llvm::Module& module, const llvm::Function& fn) {
+    llvm::ValueToValueMapTy vmap;
+    auto part = llvm::CloneModule(module, vmap, [&](const llvm::GlobalValue* global) {
+        if (global == &fn || global->hasLocalLinkage()) return true;
+        auto* var = llvm::dyn_cast<llvm::GlobalVariable>(global);
+        return var && var->isConstant();
+    });
+    if (auto* used = part->getGlobalVariable("llvm.used")) used->eraseFromParent();
+    for (auto& global : part->globals()) {
+        if (!global.isDeclaration()) global.setLinkage(llvm::GlobalValue::PrivateLinkage);
+    }
+
+    /* Drop the copies fn does not need, they would only make unrelated
+     * changes look like changes of fn. */
+    bool erased = true;
+    while (erased) {
+        erased = false;
+        for (auto it = part->global_begin(); it != part->global_end();) {
+            llvm::GlobalVariable& global = *it++;
+            /* e.g. the gep of an erased crt_string literal */
+            global.removeDeadConstantUsers();
+            if (global.use_empty()) {
+                global.eraseFromParent();
+                erased = true;
+            }
+        }
+        for (auto it = part->begin(); it != part->end();) {
+            llvm::Function& other = *it++;
+            other.removeDeadConstantUsers();
+            if (other.getName() != fn.getName() && other.use_empty()) {
+                other.eraseFromParent();
+                erased = true;
+            }
+        }
+    }
+    return part;
+}
+
+/* Names the code of fn body_name. Everything but direct calls (e.g. crt_fn
+ * objects) keeps referring to the stub, so it sees later versions too. */
+static void rename_to_body(llvm::Module& part, const std::string& name, const std::string& body_name) {
+    llvm::Function* fn = part.getFunction(name);
+    fn->setName(body_name);
+    fn->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    auto* stub = llvm::Function::Create(fn->getFunctionType(), llvm::GlobalValue::ExternalLinkage, name, part);
+    fn->replaceUsesWithIf(stub, [](llvm::Use& use) {
+        auto* call = llvm::dyn_cast<llvm::CallBase>(use.getUser());
+        return !call || !call->isCallee(&use);
+    });
+}
+
+HotReloader::HotReloader(llvm::orc::LLJIT& jit) : jit(jit) {
+    stubs = llvm::orc::createLocalIndirectStubsManagerBuilder(jit.getTargetTriple())();
+}
+
+llvm::Expected<HotReloadStats> HotReloader::load(llvm::orc::ThreadSafeModule tsm) {
+    HotReloadStats stats;
+    if (!stubs) return llvm::createStringError(llvm::inconvertibleErrorCode(), "no indirect stubs for this target");
+    if (auto err = load_globals(tsm)) return std::move(err);
+
+    struct Part {
+        std::string name;
+        std::string ir;
+        std::unique_ptr<llvm::Module> module;
+    };
+    std::vector<Part> parts;
+    tsm.withModuleDo([&](llvm::Module& module) {
+        for (auto& fn : module) {
+            if (fn.isDeclaration() || fn.hasLocalLinkage()) continue;
+            Part part{fn.getName().str(), "", split_function(module, fn)};
+            llvm::raw_string_ostream os(part.ir);
+            part.module->print(os, nullptr);
+            os.flush();
+
+            auto loaded = functions.find(part.name);
+            if (loaded != functions.end() && loaded->second.ir == part.ir) {
+                stats.num_unchanged++;
+                continue;
+            }
+            parts.push_back(std::move(part));
+        }
+    });
+
+    /* The new code may call any of the new functions, their stubs have to
+     * exist before anything is linked. */
+    for (auto& part : parts) {
+        if (functions.count(part.name)) continue;
+        if (auto err = create_stub(part.name)) return std::move(err);
+        functions[part.name] = LoadedFunction();
+    }
+
+    std::vector<llvm::orc::ResourceTrackerSP> trackers;
+    std::vector<std::string> body_names;
+    for (auto& part : parts) {
+        LoadedFunction& loaded = functions[part.name];
+        std::string body_name = part.name + ".v" + std::to_string(loaded.version + 1);
+        rename_to_body(*part.module, part.name, body_name);
+
+        auto tracker = jit.getMainJITDylib().createResourceTracker();
+        if (auto err = jit.addIRModule(tracker, llvm::orc::ThreadSafeModule(std::move(part.module), tsm.getContext()))) {
+            return std::move(err);
+        }
+        trackers.push_back(tracker);
+        body_names.push_back(body_name);
+    }
+
+    /* Compiles the new versions, then switches the stubs over. */
+    for (size_t i = 0; i < parts.size(); ++i) {
+        auto address = jit.lookup(body_names[i]);
+        if (!address) return address.takeError();
+        if (auto err = stubs->updatePointer(parts[i].name, address->getValue())) return std::move(err);
+    }
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        LoadedFunction& loaded = functions[parts[i].name];
+        if (loaded.tracker) {
+            if (auto err = loaded.tracker->remove()) return std::move(err);
+            stats.num_removed++;
+        }
+        loaded.ir = std::move(parts[i].ir);
+        loaded.version++;
+        loaded.tracker = trackers[i];
+        stats.num_compiled++;
+    }
+    return stats;
+}
+
+llvm::Error HotReloader::load_globals(llvm::orc::ThreadSafeModule& tsm) {
+    std::unique_ptr<llvm::Module> data;
+    tsm.withModuleDo([&](llvm::Module& module) {
+        std::set<const llvm::GlobalValue*> new_globals;
+        for (auto& global : module.globals()) {
+            if (global.isDeclaration() || global.isConstant() || global.hasLocalLinkage() ||
+                global.getName().startswith("llvm.")) {
+                continue;
+            }
+            if (globals.insert(global.getName().str()).second) new_globals.insert(&global);
+        }
+        if (new_globals.empty()) return;
+
+        llvm::ValueToValueMapTy vmap;
+        data = llvm::CloneModule(module, vmap,
+                                 [&](const llvm::GlobalValue* global) { return new_globals.count(global) > 0; });
+        if (auto* used = data->getGlobalVariable("llvm.used")) used->eraseFromParent();
+        /* The one definition, the function modules only get weak ones from
+         * the backend (e.g. for the gc root chain). */
+        for (auto& global : data->globals()) {
+            if (!global.isDeclaration()) global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    });
+    if (!data) return llvm::Error::success();
+    return jit.addIRModule(llvm::orc::ThreadSafeModule(std::move(data), tsm.getContext()));
+}
+
+llvm::Error HotReloader::create_stub(const std::string& name) {
+    auto flags = llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable;
+    if (auto err = stubs->createStub(name, 0, flags)) return err;
+    llvm::JITEvaluatedSymbol stub = stubs->findStub(name, true);
+    auto& session = jit.getExecutionSession();
+    return jit.getMainJITDylib().define(llvm::orc::absoluteSymbols({{session.intern(name), stub}}));
+}
@@ -0,0 +1,107 @@
+#include "carl/jit2/object_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "carl/common.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace carl;
+
+static constexpr const char* KEY_PREFIX = "carl-";
+/* Bump when the layout of cached objects changes within a version. */
+static constexpr int CACHE_FORMAT = 2;
+
+/* Changes whenever carl is rebuilt, the runtime functions cached objects call
+ * are part of the executable. */
+static std::string executable_stamp() {
+    std::string path = llvm::sys::fs::getMainExecutable(nullptr, nullptr);
+    llvm::sys::fs::file_status status;
+    if (path.empty() || llvm::sys::fs::status(path, status)) return "unknown";
+    return std::to_string(status.getSize()) + " " +
+           std::to_string(status.getLastModificationTime().time_since_epoch().count());
+}
+
+static std::string host_cpu_features() {
+    llvm::StringMap<bool> features;
+    llvm::sys::getHostCPUFeatures(features);
+    std::vector<std::string> enabled;
+    for (auto& feature : features) {
+        if (feature.getValue()) enabled.push_back(feature.getKey().str());
+    }
+    std::sort(enabled.begin(), enabled.end());
+    return llvm::join(enabled, ",");
+}
+
+CarlObjectCache::CarlObjectCache(std::string directory) : directory(std::move(directory)) {
+    llvm::sys::fs::create_directories(this->directory);
+}
+
+std::string CarlObjectCache::make_key(const std::string& source, const std::string& flags) {
+    std::string input;
+    static const std::string stamp = executable_stamp();
+    static const std::string cpu_features = host_cpu_features();
+    input += "carl " CARL_VERSION "\n";
+    input += "format " + std::to_string(CACHE_FORMAT) + "\n";
+    input += "executable " + stamp + "\n";
+    input += "llvm " LLVM_VERSION_STRING "\n";
+    input += "cpu " + llvm::sys::getHostCPUName().str() + "\n";
+    input += "features " + cpu_features + "\n";
+    input += "flags " + flags + "\n";
+    input += source;
+
+    auto hash = llvm::SHA1::hash(llvm::arrayRefFromStringRef(input));
+    return KEY_PREFIX + llvm::toHex(hash, true);
+}
+
+bool CarlObjectCache::is_key(const std::string& name) {
+    /* The lazy jit compiles partitions of a module under derived names, those
+     * must not end up in the cache under the key of the whole module. */
+    static const size_t key_length = strlen(KEY_PREFIX) + 2 * 20;
+    return name.size() == key_length && name.rfind(KEY_PREFIX, 0) == 0;
+}
+
+std::string CarlObjectCache::path_of(const std::string& key) const {
+    llvm::SmallString<256> path(directory);
+    llvm::sys::path::append(path, key + ".o");
+    return std::string(path);
+}
+
+void CarlObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) {
+    const std::string& key = module->getModuleIdentifier();
+    if (!is_key(key)) return;
+
+    /* Write to a temporary file first so concurrent runs never see half
+     * written objects. */
+    llvm::SmallString<256> tmp_path;
+    int fd;
+    if (llvm::sys::fs::createUniqueFile(path_of(key) + ".tmp-%%%%%%", fd, tmp_path)) {
+        return;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+        os << object.getBuffer();
+    }
+    if (llvm::sys::fs::rename(tmp_path, path_of(key))) {
+        llvm::sys::fs::remove(tmp_path);
+    }
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CarlObjectCache::getObject(const llvm::Module* module) {
+    const std::string& key = module->getModuleIdentifier();
+    if (!is_key(key)) return nullptr;
+    return get_object(key);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CarlObjectCache::get_object(const std::string& key) {
+    auto buffer = llvm::MemoryBuffer::getFile(path_of(key));
+    if (!buffer) return nullptr;
+    return std::move(*buffer);
+}
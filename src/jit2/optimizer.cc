@@ -0,0 +1,131 @@
+#include "carl/jit2/optimizer.h"
+
+#include <set>
+#include <vector>
+
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace carl;
+
+static llvm::OptimizationLevel to_llvm_level(OptLevel level) {
+    switch (level) {
+        case OptLevel::O0:
+            return llvm::OptimizationLevel::O0;
+        case OptLevel::O1:
+            return llvm::OptimizationLevel::O1;
+        case OptLevel::O2:
+            return llvm::OptimizationLevel::O2;
+        case OptLevel::O3:
+            return llvm::OptimizationLevel::O3;
+        case OptLevel::Os:
+            return llvm::OptimizationLevel::Os;
+    }
+    return llvm::OptimizationLevel::O2;
+}
+
+std::optional<OptLevel> carl::parse_opt_level(const std::string& level) {
+    if (level == "0") return OptLevel::O0;
+    if (level == "1") return OptLevel::O1;
+    if (level == "2") return OptLevel::O2;
+    if (level == "3") return OptLevel::O3;
+    if (level == "s") return OptLevel::Os;
+    return std::nullopt;
+}
+
+const char* carl::opt_level_name(OptLevel level) {
+    switch (level) {
+        case OptLevel::O0:
+            return "O0";
+        case OptLevel::O1:
+            return "O1";
+        case OptLevel::O2:
+            return "O2";
+        case OptLevel::O3:
+            return "O3";
+        case OptLevel::Os:
+            return "Os";
+    }
+    return "O2";
+}
+
+llvm::CodeGenOpt::Level carl::codegen_opt_level(OptLevel level) {
+    switch (level) {
+        case OptLevel::O0:
+            return llvm::CodeGenOpt::None;
+        case OptLevel::O1:
+            return llvm::CodeGenOpt::Less;
+        case OptLevel::O2:
+        case OptLevel::Os:
+            return llvm::CodeGenOpt::Default;
+        case OptLevel::O3:
+            return llvm::CodeGenOpt::Aggressive;
+    }
+    return llvm::CodeGenOpt::Default;
+}
+
+llvm::Expected<std::unique_ptr<llvm::TargetMachine>> carl::create_host_target_machine(OptLevel level) {
+    llvm::InitializeNativeTarget();
+
+    /* detectHost() picks the host cpu and its feature flags. */
+    auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!jtmb) return jtmb.takeError();
+    jtmb->setCodeGenOptLevel(codegen_opt_level(level));
+    return jtmb->createTargetMachine();
+}
+
+/* The inliner copies the llvm.gcroot calls of an inlined function to the call
+ * site, which may be inside a loop or repeated after unrolling. The gc lowering
+ * expects one call per root slot in the entry block, and a root has to stay
+ * live for the whole frame. */
+static void canonicalize_gc_roots(llvm::Function& fn) {
+    std::vector<llvm::IntrinsicInst*> roots;
+    std::vector<llvm::IntrinsicInst*> lifetimes;
+    for (auto& bb : fn) {
+        for (auto& inst : bb) {
+            auto* intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(&inst);
+            if (!intrinsic) continue;
+            if (intrinsic->getIntrinsicID() == llvm::Intrinsic::gcroot) roots.push_back(intrinsic);
+            if (intrinsic->isLifetimeStartOrEnd()) lifetimes.push_back(intrinsic);
+        }
+    }
+
+    std::set<llvm::Value*> slots;
+    for (auto* root : roots) {
+        auto* slot = root->getArgOperand(0)->stripPointerCasts();
+        if (!slots.insert(slot).second) {
+            root->eraseFromParent();
+            continue;
+        }
+        if (auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(slot)) root->moveAfter(alloca);
+    }
+    for (auto* lifetime : lifetimes) {
+        if (slots.count(lifetime->getArgOperand(1)->stripPointerCasts())) lifetime->eraseFromParent();
+    }
+}
+
+void carl::optimize_module(llvm::Module& module, OptLevel level, llvm::TargetMachine* target_machine) {
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+
+    llvm::PassBuilder pb(target_machine);
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager mpm = level == OptLevel::O0
+                                      ? pb.buildO0DefaultPipeline(llvm::OptimizationLevel::O0)
+                                      : pb.buildPerModuleDefaultPipeline(to_llvm_level(level));
+    mpm.run(module, mam);
+
+    for (auto& fn : module) {
+        if (fn.hasGC()) canonicalize_gc_roots(fn);
+    }
+}
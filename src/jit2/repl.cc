@@ -0,0 +1,77 @@
+#include "carl/jit2/repl.h"
+
+#include <cstdio>
+
+using namespace carl;
+
+Repl::Repl(OptLevel opt_level) : jit(CarlJITOptions{.opt_level = opt_level}) {
+    codegen.set_opt_level(opt_level);
+    codegen.set_incremental(true);
+    codegen.set_entry_point(true);
+    codegen.set_print_ir(false);
+}
+
+std::optional<Codegen2Module> Repl::compile(const std::string& line) {
+    std::string& src = lines.emplace_back(line);
+    parser.has_error = false;
+    auto parsed = parser.parse_r(src, false, true);
+    if (!parsed) return std::nullopt;
+    auto decls = *parsed;
+    if (!type_inference.run(decls)) {
+        forget_definitions(decls);
+        return std::nullopt;
+    }
+
+    /* Show the value of a trailing expression, assignments stay quiet. */
+    bool has_return = false;
+    for (const auto& decl : decls) has_return |= decl->get_node_type() == AstNodeType::ReturnStmt;
+    if (!has_return && !decls.empty() && decls.back()->get_node_type() == AstNodeType::ExprStmt) {
+        auto expr = std::static_pointer_cast<ExprStmt>(decls.back())->get_expr();
+        if (expr->get_node_type() != AstNodeType::Assignment &&
+            expr->get_type()->get_base_type() != types::BaseType::VOID) {
+            decls.back() = std::make_shared<ReturnStmt>(expr);
+        }
+    }
+
+    codegen.init("line" + std::to_string(lines.size()));
+    auto module = codegen.generate(decls);
+    if (codegen.get_has_error()) {
+        forget_definitions(decls);
+        return std::nullopt;
+    }
+    declarations.insert(declarations.end(), decls.begin(), decls.end());
+    return module;
+}
+
+void Repl::forget_definitions(const std::vector<std::shared_ptr<AstNode>>& decls) {
+    for (const auto& decl : decls) {
+        std::string name;
+        if (decl->get_node_type() == AstNodeType::LetDecl) {
+            name = std::string(std::static_pointer_cast<LetDecl>(decl)->get_name());
+        } else if (decl->get_node_type() == AstNodeType::FnDecl) {
+            name = std::string(std::static_pointer_cast<FnDecl>(decl)->get_name());
+        } else {
+            continue;
+        }
+        parser.forget(name);
+        type_inference.forget(name);
+    }
+}
+
+bool Repl::eval(const std::string& line) {
+    auto module = compile(line);
+    if (!module) return false;
+    std::string entry_name = module->get_entry_name();
+    if (!jit.load_module(*module)) {
+        fprintf(stderr, "could not load the line\n");
+        return false;
+    }
+    auto entry = jit.lookup_ea(entry_name.c_str());
+    if (!entry) {
+        fprintf(stderr, "could not compile the line\n");
+        return false;
+    }
+    entry->toPtr<void()>()();
+    fflush(stdout);
+    return true;
+}
@@ -0,0 +1,146 @@
+#include "carl/jit2/runtime.h"
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <functional>
+#include <vector>
+
+#include "carl/jit2/arena.h"
+#include "carl/jit2/gc.h"
+#include "carl/jit2/thread_pool.h"
+
+using namespace carl;
+
+static ThreadPool& (*THREAD_POOL_GETTER)() = nullptr;
+
+void carl::set_thread_pool_getter(ThreadPool& (*getter)()) { THREAD_POOL_GETTER = getter; }
+
+static ThreadPool& get_thread_pool() {
+    if (THREAD_POOL_GETTER) return THREAD_POOL_GETTER();
+    static ThreadPool pool;
+    return pool;
+}
+
+/* Calls fn with one argument, arguments and results are passed as 8 byte
+ * words (see crt_array) but floats go through the float registers. */
+static uint64_t call_crt_fn1(crt_fn* fn, uint64_t x, bool x_is_float, bool ret_is_float) {
+    double x_float = std::bit_cast<double>(x);
+    if (x_is_float && ret_is_float) {
+        return std::bit_cast<uint64_t>(((double (*)(double, void*))fn->fn_impl)(x_float, fn->captures));
+    } else if (x_is_float) {
+        return ((uint64_t(*)(double, void*))fn->fn_impl)(x_float, fn->captures);
+    } else if (ret_is_float) {
+        return std::bit_cast<uint64_t>(((double (*)(uint64_t, void*))fn->fn_impl)(x, fn->captures));
+    }
+    return ((uint64_t(*)(uint64_t, void*))fn->fn_impl)(x, fn->captures);
+}
+
+/* Same for two arguments of the same type. */
+static uint64_t call_crt_fn2(crt_fn* fn, uint64_t a, uint64_t b, bool is_float) {
+    if (is_float) {
+        auto* impl = (double (*)(double, double, void*))fn->fn_impl;
+        return std::bit_cast<uint64_t>(impl(std::bit_cast<double>(a), std::bit_cast<double>(b), fn->captures));
+    }
+    return ((uint64_t(*)(uint64_t, uint64_t, void*))fn->fn_impl)(a, b, fn->captures);
+}
+
+/* Runs body over [0, n) on the thread pool, the workers allocate from the
+ * arena of the calling thread. With gc everything stays on the calling thread
+ * and the given slots are rooted while body runs. */
+static void parallel_for(uint64_t n, std::initializer_list<void**> roots,
+                         const std::function<void(uint64_t, uint64_t)>& body) {
+    if (GcHeap* gc = get_current_gc_heap()) {
+        for (void** root : roots) gc->add_root(root);
+        body(0, n);
+        for (void** root : roots) gc->remove_root(root);
+        return;
+    }
+
+    ThreadPool& pool = get_thread_pool();
+    Arena* arena = get_current_arena();
+    /* A few ranges per thread so the faster ones can steal the rest. */
+    uint64_t grain = std::max<uint64_t>(1, n / (pool.get_num_threads() * 8));
+    pool.parallel_for(n, grain, [&](uint64_t begin, uint64_t end) {
+        ArenaScope scope(arena);
+        body(begin, end);
+    });
+}
+
+extern "C" {
+
+void* crt_malloc_traced(size_t size, uint64_t ptr_mask) {
+    GcHeap* gc = get_current_gc_heap();
+    if (gc) return gc->allocate(size, ptr_mask);
+
+    Arena* arena = get_current_arena();
+    if (arena) return arena->allocate(size);
+
+    void* memory = malloc(size);
+    memset(memory, 0, size);
+    return memory;
+}
+
+void crt_array__length_error(uint64_t len) {
+    fprintf(stderr, "negative array length %lld\n", (long long)len);
+    abort();
+}
+
+void crt_array__index_error(int64_t index, uint64_t len) {
+    fprintf(stderr, "index %lld out of bounds for array of length %llu\n", (long long)index,
+            (unsigned long long)len);
+    abort();
+}
+
+void crt_gc_safepoint() {
+    GcHeap* gc = get_current_gc_heap();
+    if (gc) gc->safepoint();
+}
+
+crt_array* crt_par_map(crt_fn* fn, crt_array* array, uint64_t element_is_float, uint64_t result_is_float,
+                       uint64_t result_traced) {
+    crt_array* result = crt_array__new(array->len, result_traced);
+    auto* in = (uint64_t*)array->data;
+    auto* out = (uint64_t*)result->data;
+    parallel_for(array->len, {(void**)&fn, (void**)&array, (void**)&result}, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i) out[i] = call_crt_fn1(fn, in[i], element_is_float, result_is_float);
+    });
+    return result;
+}
+
+uint64_t crt_par_reduce(crt_fn* fn, uint64_t init, crt_array* array, uint64_t is_float) {
+    uint64_t len = array->len;
+    auto* in = (uint64_t*)array->data;
+    uint64_t chunk_size = get_current_gc_heap() ? std::max<uint64_t>(len, 1) : 1024;
+    /* Every chunk starts from its first element, init is applied once when
+     * the partials are combined, so the result does not depend on the
+     * chunking. */
+    std::vector<uint64_t> partials((len + chunk_size - 1) / chunk_size);
+    if (partials.empty()) return init;
+
+    parallel_for(partials.size(), {(void**)&fn, (void**)&array, (void**)&init, (void**)partials.data()},
+                 [&](uint64_t begin, uint64_t end) {
+                     for (uint64_t chunk = begin; chunk < end; ++chunk) {
+                         uint64_t first = chunk * chunk_size;
+                         uint64_t last = std::min(len, first + chunk_size);
+                         uint64_t& acc = partials[chunk];
+                         acc = in[first];
+                         for (uint64_t i = first + 1; i < last; ++i) {
+                             acc = call_crt_fn2(fn, acc, in[i], is_float);
+                         }
+                     }
+                 });
+
+    uint64_t acc = init;
+    for (uint64_t partial : partials) acc = call_crt_fn2(fn, acc, partial, is_float);
+    return acc;
+}
+
+void crt_print_int(int64_t value) { printf("%" PRId64 "\n", value); }
+
+void crt_print_bool(uint64_t value) { printf("%s\n", value ? "true" : "false"); }
+
+void crt_print_float(double value) { printf("%g\n", value); }
+
+void crt_print_string(crt_string* value) { printf("%s\n", value->data); }
+}
@@ -0,0 +1,63 @@
+#include "carl/jit2/runtime_bitcode.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA1.h"
+
+using namespace carl;
+
+/* Read once, parsed into the context of every module it is linked into. */
+static const llvm::MemoryBuffer* get_runtime_bitcode() {
+#ifdef CARL_RUNTIME_BITCODE
+    static auto buffer = llvm::MemoryBuffer::getFile(CARL_RUNTIME_BITCODE);
+    if (buffer) return buffer->get();
+#endif
+    return nullptr;
+}
+
+bool carl::has_runtime_bitcode() { return get_runtime_bitcode(); }
+
+std::string carl::runtime_bitcode_hash() {
+    const llvm::MemoryBuffer* bitcode = get_runtime_bitcode();
+    if (!bitcode) return "";
+    static std::string hash = llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(bitcode->getBuffer())), true);
+    return hash;
+}
+
+bool carl::link_runtime_bitcode(llvm::Module& module) {
+    const llvm::MemoryBuffer* bitcode = get_runtime_bitcode();
+    if (!bitcode) return false;
+
+    auto runtime = llvm::parseBitcodeFile(bitcode->getMemBufferRef(), module.getContext());
+    if (!runtime) {
+        llvm::consumeError(runtime.takeError());
+        return false;
+    }
+    /* clang built it for the same host, this only avoids llvm's warning about
+     * differently spelled triples. */
+    (*runtime)->setDataLayout(module.getDataLayout());
+    (*runtime)->setTargetTriple(module.getTargetTriple());
+
+    bool failed = llvm::Linker::linkModules(
+        module, std::move(*runtime), llvm::Linker::LinkOnlyNeeded,
+        [](llvm::Module& linked, const llvm::StringSet<>& names) {
+            for (auto& name : names) {
+                llvm::Function* fn = linked.getFunction(name.getKey());
+                if (!fn || fn->isDeclaration()) continue;
+                /* Private copies, the jit and executables still have the
+                 * exported ones for everything that is not inlined. */
+                fn->setLinkage(llvm::GlobalValue::InternalLinkage);
+                fn->addFnAttr(llvm::Attribute::AlwaysInline);
+                fn->removeFnAttr(llvm::Attribute::NoInline);
+                fn->removeFnAttr(llvm::Attribute::OptimizeNone);
+                /* Generated code uses the features of the host cpu, the
+                 * defaults clang compiled for must not block inlining. */
+                fn->removeFnAttr("target-cpu");
+                fn->removeFnAttr("target-features");
+                fn->removeFnAttr("tune-cpu");
+            }
+        });
+    return !failed;
+}
@@ -0,0 +1,77 @@
+#include "carl/jit2/runtime.h"
+
+/*
+Runtime helpers that are worth inlining into generated code. Besides being part
+of carl-runtime this file is compiled to bitcode (carl-runtime.bc) which
+link_runtime_bitcode() links into every generated module before optimisation.
+
+Everything called from here has to be a host function of the jit (or an llvm
+intrinsic like memcpy), the bitcode can not refer to anything else of the
+host. That includes the allocation itself: crt_malloc_traced stays a call into
+the host for the arena and for the gc heap, only the code around it inlines.
+*/
+
+extern "C" {
+
+void* crt_malloc(size_t size) { return crt_malloc_traced(size, 0); }
+
+crt_string* crt_string__concat(crt_string* a, crt_string* b) {
+    /* data is the second word of crt_string */
+    crt_string* result = (crt_string*)crt_malloc_traced(sizeof(crt_string), 0b10);
+    result->data = (const char*)crt_malloc(a->len + b->len - 1);
+    result->len = a->len + b->len - 1;
+    memcpy((void*)result->data, a->data, a->len);
+    memcpy((void*)(result->data + a->len - 1), b->data, b->len);
+    return result;
+}
+
+crt_string* crt_string__concat_n(uint64_t n, crt_string** parts) {
+    uint64_t len = 1;
+    for (uint64_t i = 0; i < n; ++i) len += parts[i]->len - 1;
+
+    crt_string* result = (crt_string*)crt_malloc_traced(sizeof(crt_string), 0b10);
+    char* data = (char*)crt_malloc(len);
+    result->data = data;
+    result->len = len;
+    for (uint64_t i = 0; i < n; ++i) {
+        memcpy(data, parts[i]->data, parts[i]->len - 1);
+        data += parts[i]->len - 1;
+    }
+    *data = '\0';
+    return result;
+}
+
+crt_string* crt_string__append_n(crt_string* s, uint64_t* capacity, uint64_t n, crt_string** parts) {
+    uint64_t len = s->len;
+    for (uint64_t i = 0; i < n; ++i) len += parts[i]->len - 1;
+
+    crt_string* result = s;
+    if (len > *capacity) {
+        /* Twice the length, a loop of appends copies each character a
+         * constant number of times. */
+        *capacity = 2 * len;
+        result = (crt_string*)crt_malloc_traced(sizeof(crt_string), 0b10);
+        result->data = (const char*)crt_malloc(*capacity);
+        memcpy((void*)result->data, s->data, s->len - 1);
+    }
+    /* Otherwise nothing else refers to s, it grows in place. */
+    char* data = (char*)result->data + s->len - 1;
+    for (uint64_t i = 0; i < n; ++i) {
+        memcpy(data, parts[i]->data, parts[i]->len - 1);
+        data += parts[i]->len - 1;
+    }
+    *data = '\0';
+    result->len = len;
+    return result;
+}
+
+crt_array* crt_array__new(uint64_t len, uint64_t elements_traced) {
+    if ((int64_t)len < 0) crt_array__length_error(len);
+    /* data is the third word of crt_array */
+    crt_array* result = (crt_array*)crt_malloc_traced(sizeof(crt_array), 0b100);
+    result->data = crt_malloc_traced(len * sizeof(uint64_t), elements_traced ? CRT_GC_SCAN_ALL : 0);
+    result->len = len;
+    result->capacity = len;
+    return result;
+}
+}
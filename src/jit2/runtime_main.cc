@@ -0,0 +1,16 @@
+#include "carl/jit2/arena.h"
+#include "carl/jit2/runtime.h"
+
+/* Emitted by Codegen2::set_entry_point(), runs the program and prints its
+ * result. */
+extern "C" void __carl_entry();
+
+/* main() of executables built ahead of time (carl build), everything the
+ * program allocates comes from one arena that lives until the process exits. */
+int main() {
+    carl::Arena heap;
+    carl::set_current_arena(&heap);
+    __carl_entry();
+    carl::set_current_arena(nullptr);
+    return 0;
+}
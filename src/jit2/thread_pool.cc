@@ -0,0 +1,144 @@
+#include "carl/jit2/thread_pool.h"
+
+#include <algorithm>
+
+using namespace carl;
+
+/* Pool whose job the current thread is working on. */
+static thread_local ThreadPool* CURRENT_POOL = nullptr;
+
+ThreadPool::ThreadPool(unsigned num_threads) {
+    if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < num_threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i + 1 < num_threads; ++i) {
+        workers.emplace_back([this, i] { run_worker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    job_available.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::parallel_for(uint64_t n, uint64_t grain, const std::function<void(uint64_t, uint64_t)>& body) {
+    if (n == 0) return;
+    if (CURRENT_POOL == this || workers.empty() || n <= grain) {
+        body(0, n);
+        return;
+    }
+
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+    this->body = &body;
+    this->grain = std::max<uint64_t>(grain, 1);
+    remaining = n;
+    num_jobs++;
+
+    uint64_t num_threads = queues.size();
+    for (uint64_t i = 0; i < num_threads; ++i) {
+        Range range{n * i / num_threads, n * (i + 1) / num_threads};
+        if (range.begin != range.end) push(i, range);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        num_active = workers.size();
+    }
+    job_available.notify_all();
+
+    run_ranges(num_threads - 1);
+
+    /* body lives on our caller's stack, no worker may touch it afterwards. */
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this] { return num_active == 0; });
+    this->body = nullptr;
+}
+
+ThreadPoolStats ThreadPool::get_stats() const { return {num_jobs.load(), num_steals.load()}; }
+
+void ThreadPool::run_worker(unsigned index) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        job_available.wait(lock, [&] { return stop || generation != seen; });
+        if (stop) return;
+        seen = generation;
+
+        lock.unlock();
+        run_ranges(index);
+        lock.lock();
+
+        if (--num_active == 0) job_done.notify_all();
+    }
+}
+
+void ThreadPool::run_ranges(unsigned index) {
+    ThreadPool* previous = CURRENT_POOL;
+    CURRENT_POOL = this;
+    Range range;
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!pop(index, range) && !steal(index, range)) {
+            /* The rest is being worked on, some of it may still be split. The
+             * waiting count is published before the queues are checked again,
+             * so push() and the last range see us and wake us up. */
+            std::unique_lock<std::mutex> lock(ranges_mutex);
+            num_waiting++;
+            ranges_available.wait(lock, [this] { return num_queued > 0 || remaining == 0; });
+            num_waiting--;
+            continue;
+        }
+        while (range.end - range.begin > grain) {
+            uint64_t middle = range.begin + (range.end - range.begin) / 2;
+            push(index, {middle, range.end});
+            range.end = middle;
+        }
+        (*body)(range.begin, range.end);
+        if (remaining.fetch_sub(range.end - range.begin) == range.end - range.begin) {
+            wake_waiting();
+        }
+    }
+    CURRENT_POOL = previous;
+}
+
+void ThreadPool::push(unsigned index, Range range) {
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->ranges.push_back(range);
+    }
+    num_queued++;
+    wake_waiting();
+}
+
+void ThreadPool::wake_waiting() {
+    if (num_waiting == 0) return;
+    /* Taking the lock orders us after a waiter's predicate check. */
+    { std::lock_guard<std::mutex> lock(ranges_mutex); }
+    ranges_available.notify_all();
+}
+
+bool ThreadPool::pop(unsigned index, Range& range) {
+    Queue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.ranges.empty()) return false;
+    range = queue.ranges.back();
+    queue.ranges.pop_back();
+    num_queued--;
+    return true;
+}
+
+bool ThreadPool::steal(unsigned index, Range& range) {
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& queue = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.ranges.empty()) continue;
+        range = queue.ranges.front();
+        queue.ranges.pop_front();
+        num_queued--;
+        num_steals++;
+        return true;
+    }
+    return false;
+}
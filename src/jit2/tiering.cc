@@ -0,0 +1,244 @@
+#include "carl/jit2/tiering.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+using namespace carl;
+
+TieredCompiler::TieredCompiler(llvm::orc::LLJIT& jit, uint64_t threshold, OptLevel opt_level)
+    : jit(jit), threshold(threshold), opt_level(opt_level) {
+    worker = std::thread([this] { run_worker(); });
+}
+
+TieredCompiler::~TieredCompiler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    work_available.notify_all();
+    worker.join();
+}
+
+void TieredCompiler::instrument(llvm::Module& module) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    /* The optimized functions live in their own modules and link against the
+     * globals of this one, so nothing may stay module local. The module
+     * number keeps string constants, helper closures etc. of different
+     * modules apart. */
+    std::string prefix = "m" + std::to_string(num_modules++) + ".";
+    for (auto& global : module.global_values()) {
+        if (global.hasLocalLinkage() && !global.getName().startswith("llvm.")) {
+            global.setName(prefix + global.getName());
+            global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    }
+
+    auto bitcode = std::make_shared<llvm::SmallVector<char, 0>>();
+    llvm::raw_svector_ostream os(*bitcode);
+    llvm::WriteBitcodeToFile(module, os);
+
+    std::vector<llvm::Function*> hot_candidates;
+    for (auto& fn : module) {
+        if (fn.isDeclaration()) continue;
+        if (fn.getName().endswith("_impl") || fn.getName().startswith("__carl_main")) hot_candidates.push_back(&fn);
+    }
+
+    for (auto* fn : hot_candidates) {
+        uint64_t id = functions.size();
+        functions.push_back({bitcode, fn->getName().str()});
+        /* main runs once, only its loops can make it hot */
+        instrument_function(*fn, id, !fn->getName().startswith("__carl_main"));
+    }
+}
+
+void TieredCompiler::instrument_function(llvm::Function& fn, uint64_t id, bool count_calls) {
+    llvm::Module& module = *fn.getParent();
+    llvm::LLVMContext& context = module.getContext();
+    auto* ptr_type = llvm::PointerType::get(context, 0);
+    auto* i64_type = llvm::Type::getInt64Ty(context);
+    std::string name = fn.getName().str();
+
+    auto* slot = new llvm::GlobalVariable(module, ptr_type, false, llvm::GlobalValue::ExternalLinkage, &fn,
+                                          name + ".slot");
+    auto* hotness = new llvm::GlobalVariable(module, i64_type, false, llvm::GlobalValue::ExternalLinkage,
+                                             llvm::ConstantInt::get(i64_type, 0), name + ".hotness");
+    auto* tier_up_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), {i64_type, ptr_type}, false);
+    auto crt_tier_up = module.getOrInsertFunction("crt_tier_up", tier_up_type);
+
+    /* Counts a call or loop iteration before `before`, the one that reaches
+     * the threshold requests the tier up. */
+    auto count = [&](llvm::Instruction* before) {
+        llvm::IRBuilder<> builder(before);
+        auto* count = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, hotness, llvm::ConstantInt::get(i64_type, 1),
+                                              llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+        auto* is_hot = builder.CreateICmpEQ(count, llvm::ConstantInt::get(i64_type, threshold - 1), "is_hot");
+        auto* tier_up = llvm::SplitBlockAndInsertIfThen(is_hot, before, false);
+        tier_up->getParent()->setName("tier_up");
+        builder.SetInsertPoint(tier_up);
+        builder.CreateCall(crt_tier_up, {llvm::ConstantInt::get(i64_type, id), slot})->setDoesNotThrow();
+    };
+
+    /* New crt_fn objects get the current version of the function. */
+    std::vector<llvm::StoreInst*> stores;
+    for (auto* user : fn.users()) {
+        auto* store = llvm::dyn_cast<llvm::StoreInst>(user);
+        if (store && store->getValueOperand() == &fn) stores.push_back(store);
+    }
+    for (auto* store : stores) {
+        llvm::IRBuilder<> builder(store);
+        auto* current = builder.CreateAlignedLoad(ptr_type, slot, llvm::MaybeAlign(8), name + ".current");
+        current->setAtomic(llvm::AtomicOrdering::Acquire);
+        store->setOperand(0, current);
+    }
+
+    /* Loops count their back edges, there is no on stack replacement though:
+     * a long running loop tiers up the function for its next call. */
+    llvm::DominatorTree dominators(fn);
+    std::vector<std::pair<llvm::BasicBlock*, llvm::BasicBlock*>> back_edges;
+    for (auto& bb : fn) {
+        for (auto* successor : llvm::successors(&bb)) {
+            if (dominators.dominates(successor, &bb)) back_edges.emplace_back(&bb, successor);
+        }
+    }
+    for (auto [from, to] : back_edges) {
+        llvm::BasicBlock* latch = llvm::SplitEdge(from, to);
+        latch->setName("back_edge");
+        count(latch->getTerminator());
+    }
+
+    /* Allocas and gc roots have to stay in the entry block, the dispatch goes
+     * right after them. */
+    llvm::BasicBlock& entry = fn.getEntryBlock();
+    auto it = entry.begin();
+    while (llvm::isa<llvm::AllocaInst>(*it) ||
+           (llvm::isa<llvm::IntrinsicInst>(*it) &&
+            llvm::cast<llvm::IntrinsicInst>(*it).getIntrinsicID() == llvm::Intrinsic::gcroot)) {
+        ++it;
+    }
+    llvm::BasicBlock* body = entry.splitBasicBlock(it, "body");
+    entry.getTerminator()->eraseFromParent();
+
+    auto* dispatch = llvm::BasicBlock::Create(context, "dispatch", &fn, body);
+    auto* forward = llvm::BasicBlock::Create(context, "forward", &fn, body);
+
+    llvm::IRBuilder<> builder(&entry);
+    auto* to_dispatch = builder.CreateBr(dispatch);
+    if (count_calls) count(to_dispatch);
+
+    builder.SetInsertPoint(dispatch);
+    auto* current = builder.CreateAlignedLoad(ptr_type, slot, llvm::MaybeAlign(8), "current");
+    current->setAtomic(llvm::AtomicOrdering::Acquire);
+    auto* is_swapped = builder.CreateICmpNE(current, &fn, "is_swapped");
+    builder.CreateCondBr(is_swapped, forward, body);
+
+    builder.SetInsertPoint(forward);
+    std::vector<llvm::Value*> args;
+    for (auto& arg : fn.args()) args.push_back(&arg);
+    auto* call = builder.CreateCall(fn.getFunctionType(), current, args);
+    call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    call->setDoesNotThrow();
+    if (fn.getReturnType()->isVoidTy()) {
+        builder.CreateRetVoid();
+    } else {
+        builder.CreateRet(call);
+    }
+}
+
+void TieredCompiler::request(uint64_t id, void** slot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        /* Ids of modules from another jit (e.g. a stale object) */
+        if (id >= functions.size()) return;
+        queue.push_back({id, slot});
+        stats.num_requests++;
+    }
+    work_available.notify_one();
+}
+
+void TieredCompiler::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+TieringStats TieredCompiler::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void TieredCompiler::run_worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        work_available.wait(lock, [this] { return stop || !queue.empty(); });
+        if (stop) return;
+
+        Request request = queue.front();
+        queue.pop_front();
+        TieredFunction fn = functions[request.id];
+        busy = true;
+
+        lock.unlock();
+        llvm::Error err = compile(fn, request.slot);
+        lock.lock();
+
+        if (err) {
+            llvm::consumeError(std::move(err));
+            stats.num_failures++;
+        } else {
+            stats.num_tier_ups++;
+        }
+        busy = false;
+        work_done.notify_all();
+    }
+}
+
+llvm::Error TieredCompiler::compile(const TieredFunction& fn, void** slot) {
+    llvm::LLVMContext context;
+    llvm::StringRef bitcode(fn.bitcode->data(), fn.bitcode->size());
+    auto parsed = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode, fn.name), context);
+    if (!parsed) return parsed.takeError();
+    std::unique_ptr<llvm::Module> module = std::move(*parsed);
+
+    /* Keep only the hot function, everything else is linked against the tier
+     * 0 module. Constants stay visible to the optimizer. */
+    if (auto* used = module->getGlobalVariable("llvm.used")) used->eraseFromParent();
+    for (auto& other : *module) {
+        if (!other.isDeclaration() && other.getName() != fn.name) other.deleteBody();
+    }
+    for (auto& global : module->globals()) {
+        if (global.isDeclaration()) continue;
+        if (global.isConstant()) {
+            global.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        } else {
+            global.setInitializer(nullptr);
+            global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    }
+    std::string tier1_name = fn.name + ".tier1";
+    module->getFunction(fn.name)->setName(tier1_name);
+
+    auto target_machine = create_host_target_machine(opt_level);
+    if (!target_machine) return target_machine.takeError();
+    module->setDataLayout((*target_machine)->createDataLayout());
+    module->setTargetTriple((*target_machine)->getTargetTriple().str());
+
+    optimize_module(*module, opt_level, target_machine->get());
+
+    llvm::orc::SimpleCompiler compiler(**target_machine);
+    auto object = compiler(*module);
+    if (!object) return object.takeError();
+
+    auto tracker = jit.getMainJITDylib().createResourceTracker();
+    if (auto err = jit.addObjectFile(tracker, std::move(*object))) return err;
+    auto address = jit.lookup(tier1_name);
+    if (!address) return address.takeError();
+
+    __atomic_store_n(slot, address->toPtr<void*>(), __ATOMIC_RELEASE);
+    return llvm::Error::success();
+}
@@ -4,18 +4,78 @@ set(SRC_CC
     src/ast/print_visitor.cc
     src/ast/ast_printer.cc
     src/ast/type_inference.cc
+    src/ast/constant_folding.cc
+    src/ast/escape_analysis.cc
+    src/ast/intrinsics.cc
+    src/jit2/aot.cc
     src/jit2/codegen2.cc
+    src/jit2/hot_reload.cc
+    src/jit2/object_cache.cc
+    src/jit2/optimizer.cc
+    src/jit2/repl.cc
+    src/jit2/runtime_bitcode.cc
+    src/jit2/tiering.cc
     src/jit2/carljit.cc
     src/parser.cc 
     src/scanner.cc 
 )
 
+# Everything generated code calls, without llvm. Executables built ahead of
+# time link against it (and carl-runtime-main for their main function).
+set(RUNTIME_CC
+    src/jit2/arena.cc
+    src/jit2/gc.cc
+    src/jit2/thread_pool.cc
+    src/jit2/runtime.cc
+    src/jit2/runtime_inline.cc
+)
+
+add_library(
+    carl-runtime
+    STATIC
+    ${RUNTIME_CC}
+)
+set_target_properties(carl-runtime PROPERTIES POSITION_INDEPENDENT_CODE ON)
+
+add_library(
+    carl-runtime-main
+    STATIC
+    src/jit2/runtime_main.cc
+)
+
 add_library(
     carl-lib
     STATIC
     ${SRC_CC}
     ${INCLUDE_H}
 )
+target_link_libraries(carl-lib carl-runtime)
+# carl build links executables against the runtime libraries
+target_compile_definitions(carl-lib PRIVATE CARL_RUNTIME_DIR="$<TARGET_FILE_DIR:carl-runtime>")
+add_dependencies(carl-lib carl-runtime-main)
+
+# The helpers of runtime_inline.cc as bitcode, linked into generated modules so
+# they can be inlined. Needs a clang that writes bitcode llvm can read.
+find_program(CARL_CLANG NAMES clang++-${LLVM_VERSION_MAJOR} clang++ HINTS ${LLVM_TOOLS_BINARY_DIR})
+if(CARL_CLANG)
+    set(RUNTIME_BITCODE ${CMAKE_BINARY_DIR}/carl-runtime.bc)
+    add_custom_command(
+        OUTPUT ${RUNTIME_BITCODE}
+        COMMAND ${CARL_CLANG} -std=c++20 -O2 -fno-exceptions -emit-llvm -c
+                -I${CMAKE_SOURCE_DIR}/include
+                ${CMAKE_SOURCE_DIR}/src/jit2/runtime_inline.cc -o ${RUNTIME_BITCODE}
+        DEPENDS
+            src/jit2/runtime_inline.cc
+            include/carl/jit2/runtime.h
+            include/carl/jit2/runtime_types.h
+    )
+    add_custom_target(carl-runtime-bitcode DEPENDS ${RUNTIME_BITCODE})
+    add_dependencies(carl-lib carl-runtime-bitcode)
+    target_compile_definitions(carl-lib PRIVATE CARL_RUNTIME_BITCODE="${RUNTIME_BITCODE}")
+    message(STATUS "runtime helpers are inlined into generated code, allocations (crt_malloc_traced, arena and gc) stay host calls")
+else()
+    message(STATUS "clang not found, generated code calls the runtime without inlining")
+endif()
 
 add_executable(
     carl
@@ -29,3 +89,7 @@ target_link_libraries(
     ${LLVM_LIBS}
     ${LLVM_LDFLAGS}
 )
+
+# carl build finds the runtime in ../lib relative to the installed carl
+install(TARGETS carl RUNTIME DESTINATION bin)
+install(TARGETS carl-runtime carl-runtime-main ARCHIVE DESTINATION lib)
@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "carl/ast/intrinsics.h"
 #include "carl/ast/type_inference.h"
 #include "carl/common.h"
 
@@ -46,6 +47,8 @@ static const std::unordered_map<TokenType, ParseRule> parse_rules = {
     {TOKEN_RIGHT_PAREN, {PREC_NONE, nullptr, nullptr}},
     {TOKEN_LEFT_BRACE, {PREC_NONE, nullptr, nullptr}},
     {TOKEN_RIGHT_BRACE, {PREC_NONE, nullptr, nullptr}},
+    {TOKEN_LEFT_BRACKET, {PREC_PRIMARY, &Parser::array, &Parser::index}},
+    {TOKEN_RIGHT_BRACKET, {PREC_NONE, nullptr, nullptr}},
     {TOKEN_COMMA, {PREC_NONE, nullptr, nullptr}},
     {TOKEN_DOT, {PREC_COMPOSITION, nullptr, &Parser::binary}},
     {TOKEN_MINUS, {PREC_TERM, &Parser::unary, &Parser::binary}},
@@ -55,6 +58,7 @@ static const std::unordered_map<TokenType, ParseRule> parse_rules = {
     {TOKEN_STAR, {PREC_FACTOR, nullptr, &Parser::binary}},
     {TOKEN_PIPE, {PREC_NONE, nullptr, nullptr}},
     {TOKEN_PERC, {PREC_FACTOR, nullptr, &Parser::binary}},
+    {TOKEN_UNDERSCORE, {PREC_NONE, nullptr, nullptr}},
     {TOKEN_BANG, {PREC_NONE, &Parser::unary, nullptr}},
     {TOKEN_BANG_EQUAL, {PREC_EQ, nullptr, &Parser::binary}},
     {TOKEN_EQUAL, {PREC_ASSIGNMENT, nullptr, &Parser::binary}},
@@ -122,6 +126,10 @@ std::shared_ptr<Expression> Parser::parse_precedence(Precedence precedence) {
                 auto value = (this->*(infix_rule)->infix)();
                 expression = std::make_shared<Assignment>(expression, value);
             }
+        } else if (op_token.type == TOKEN_LEFT_BRACKET) {
+            // indexing, a[i]
+            auto index = (this->*(infix_rule)->infix)();
+            expression = std::make_shared<Index>(op_token, expression, index);
         } else {
             // normal binop
             auto rhs = (this->*(infix_rule)->infix)();
@@ -204,6 +212,11 @@ ParseResult Parser::parse_r(std::string& src, bool add_builtins, bool skip_type_
     return ParseResult::make_result(decls);
 }
 
+void Parser::forget(const std::string& name) {
+    environment->erase_variable(name);
+    fn_environment->erase_variable(name);
+}
+
 std::vector<std::shared_ptr<AstNode>> Parser::parse(std::string& src) {
     auto scanner = std::make_shared<Scanner>();
     scanner->init(src.c_str());
@@ -228,7 +241,12 @@ std::vector<std::shared_ptr<AstNode>> Parser::parse() {
 }
 
 std::shared_ptr<types::Type> Parser::type() {
-    if (match(TOKEN_LEFT_PAREN)) {
+    if (match(TOKEN_LEFT_BRACKET)) {
+        // [int]
+        auto element_type = type();
+        consume(TOKEN_RIGHT_BRACKET, "Expected ] after array element type.");
+        return std::make_shared<types::Array>(element_type);
+    } else if (match(TOKEN_LEFT_PAREN)) {
         // (int, string : void)
         std::vector<std::shared_ptr<types::Type>> param_types;
         while (!peek(TOKEN_COLON)) {
@@ -491,15 +509,24 @@ std::shared_ptr<Expression> Parser::call() {
     consume(TOKEN_LEFT_PAREN, "Expected '(' after function identifier.");
 
     auto args = std::list<std::shared_ptr<Expression>>();
+    bool is_partial = false;
     while (current.type != TOKEN_ERROR && current.type != TOKEN_EOF &&
            current.type != TOKEN_RIGHT_PAREN) {
-        args.push_back(expression());
+        if (match(TOKEN_UNDERSCORE)) {
+            // partial application, add(_, 2)
+            args.push_back(std::make_shared<Placeholder>(previous));
+            is_partial = true;
+        } else {
+            args.push_back(expression());
+        }
         if (!match(TOKEN_COMMA)) break;
     }
     consume(TOKEN_RIGHT_PAREN,
             "Expected ) at the end of function argument list.");
 
-    return std::make_shared<Call>(fname, args);
+    auto result = std::make_shared<Call>(fname, args);
+    result->set_is_partial(is_partial);
+    return result;
 }
 
 std::shared_ptr<Expression> Parser::literal() {
@@ -583,6 +610,34 @@ std::shared_ptr<Expression> Parser::binary() {
         static_cast<Precedence>(current_rule->prec + prec_offset));
 }
 
+std::shared_ptr<Expression> Parser::array() {
+    advance();
+    Token bracket = previous;
+    if (peek(TOKEN_RIGHT_BRACKET)) {
+        error_at(current, "Can not infer the element type of an empty array.");
+        return make_error_node<Expression>();
+    }
+
+    auto first = expression();
+    if (match(TOKEN_SEMICOLON)) {
+        // [value; count]
+        auto count = expression();
+        consume(TOKEN_RIGHT_BRACKET, "Expected ] after array length.");
+        return std::make_shared<ArrayRepeat>(bracket, first, count);
+    }
+
+    auto elements = std::list<std::shared_ptr<Expression>>{first};
+    while (match(TOKEN_COMMA)) elements.push_back(expression());
+    consume(TOKEN_RIGHT_BRACKET, "Expected ] at the end of array literal.");
+    return std::make_shared<ArrayLiteral>(bracket, elements);
+}
+
+std::shared_ptr<Expression> Parser::index() {
+    auto index = expression();
+    consume(TOKEN_RIGHT_BRACKET, "Expected ] after index.");
+    return index;
+}
+
 std::shared_ptr<Expression> Parser::grouping() {
     advance();
     auto contained_expression = expression();
@@ -626,6 +681,7 @@ bool Parser::is_captured(const std::string& name) {
 bool Parser::is_known_name(const std::string& name) {
     return fn_environment->has_variable(name) ||
            environment->has_variable(name) ||
+           intrinsic_from_name(name) != Intrinsic::NONE ||
            (std::find(known_adt_constructor_names.begin(),
                       known_adt_constructor_names.end(),
                       name) != known_adt_constructor_names.end());
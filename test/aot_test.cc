@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "carl/jit2/aot.h"
+#include "carl/jit2/codegen2.h"
+#include "carl/parser.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+
+using namespace carl;
+
+namespace {
+
+std::string make_output_dir() {
+    llvm::SmallString<128> dir;
+    llvm::sys::fs::createUniqueDirectory("carl-aot-test", dir);
+    return std::string(dir);
+}
+
+Codegen2Module generate(std::string src, bool entry_point) {
+    Parser p;
+    auto decls = p.parse_r(src, false);
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_entry_point(entry_point);
+    return cg.generate(*decls);
+}
+
+TEST(aot, emits_object_file) {
+    auto module = generate("fn add(a: int, b: int): int { return a + b; } return add(40, 2);", false);
+    std::string path = make_output_dir() + "/main.o";
+
+    AotOptions options{.output = AotOutput::OBJECT};
+    auto err = compile_ahead_of_time(module, path, options);
+    ASSERT_FALSE(err) << llvm::toString(std::move(err));
+
+    std::ifstream object(path, std::ios::binary);
+    char magic[4] = {};
+    object.read(magic, 4);
+    ASSERT_EQ(std::string(magic, 4), "\x7f" "ELF");
+}
+
+TEST(aot, rejects_unknown_cpu) {
+    auto module = generate("return 1;", false);
+    std::string path = make_output_dir() + "/main.o";
+
+    AotOptions options{.output = AotOutput::OBJECT, .cpu = "not-a-cpu"};
+    auto err = compile_ahead_of_time(module, path, options);
+    ASSERT_TRUE(!!err);
+    ASSERT_EQ(llvm::toString(std::move(err)), "unknown cpu not-a-cpu");
+}
+
+TEST(aot, executable_runs_without_jit) {
+    if (!llvm::sys::findProgramByName("c++")) GTEST_SKIP() << "no c++ to link with";
+
+    std::string src = ""
+        "fn square(x: int): int {"
+        "   return x * x;"
+        "}"
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "let squares = par_map(square, [1, 2, 3, 4]);"
+        "return par_reduce(add, 0, squares);";
+    auto module = generate(src, true);
+    std::string path = make_output_dir() + "/main";
+
+    auto err = compile_ahead_of_time(module, path, AotOptions{});
+    ASSERT_FALSE(err) << llvm::toString(std::move(err));
+
+    FILE* process = popen(path.c_str(), "r");
+    ASSERT_TRUE(process);
+    char output[128] = {};
+    size_t len = fread(output, 1, sizeof(output) - 1, process);
+    ASSERT_EQ(pclose(process), 0);
+    ASSERT_EQ(std::string(output, len), "30\n");
+}
+
+}  // namespace
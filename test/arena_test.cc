@@ -0,0 +1,81 @@
+#include "carl/jit2/arena.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace carl;
+
+namespace {
+
+TEST(Arena, allocations_are_aligned_and_zeroed) {
+    Arena arena(256);
+    for (size_t size : {1, 3, 16, 17, 100}) {
+        auto* memory = static_cast<uint8_t*>(arena.allocate(size));
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(memory) % Arena::alignment, 0);
+        for (size_t i = 0; i < size; ++i) ASSERT_EQ(memory[i], 0);
+        memset(memory, 0xff, size);
+    }
+    ASSERT_EQ(arena.get_stats().num_allocations, 5);
+}
+
+TEST(Arena, large_allocation_gets_own_chunk) {
+    Arena arena(64);
+    void* small = arena.allocate(8);
+    void* large = arena.allocate(1000);
+    ASSERT_NE(small, nullptr);
+    ASSERT_NE(large, nullptr);
+    ASSERT_GE(arena.get_stats().bytes_reserved, 64 + 1000);
+}
+
+TEST(Arena, reset_reuses_memory) {
+    Arena arena(128);
+    void* first = arena.allocate(32);
+    for (int i = 0; i < 20; ++i) arena.allocate(32);
+    ASSERT_EQ(arena.get_stats().num_allocations, 21);
+    ASSERT_EQ(arena.get_stats().bytes_allocated, 21 * 32);
+
+    arena.reset();
+    ASSERT_EQ(arena.get_stats().num_allocations, 0);
+    ASSERT_EQ(arena.get_stats().bytes_allocated, 0);
+    ASSERT_EQ(arena.allocate(32), first);
+
+    arena.release();
+    ASSERT_EQ(arena.get_stats().bytes_reserved, 0);
+}
+
+TEST(Arena, allocations_from_several_threads) {
+    Arena arena(1024);
+    std::vector<std::thread> threads;
+    std::vector<std::vector<uint64_t*>> allocations(4);
+    for (size_t t = 0; t < allocations.size(); ++t) {
+        threads.emplace_back([&, t] {
+            for (uint64_t i = 0; i < 1000; ++i) {
+                auto* memory = static_cast<uint64_t*>(arena.allocate(sizeof(uint64_t)));
+                *memory = t * 1000 + i;
+                allocations[t].push_back(memory);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    /* No allocation was handed out twice */
+    for (size_t t = 0; t < allocations.size(); ++t) {
+        for (uint64_t i = 0; i < 1000; ++i) ASSERT_EQ(*allocations[t][i], t * 1000 + i);
+    }
+    ASSERT_EQ(arena.get_stats().num_allocations, 4000);
+}
+
+TEST(Arena, scope_sets_current_arena) {
+    Arena* before = get_current_arena();
+    Arena arena;
+    {
+        ArenaScope scope(&arena);
+        ASSERT_EQ(get_current_arena(), &arena);
+    }
+    ASSERT_EQ(get_current_arena(), before);
+}
+
+}  // namespace
@@ -1,10 +1,13 @@
 #include <gtest/gtest.h>
+#include <deque>
 
 #include "carl/parser.h"
 #include "carl/jit2/carljit.h"
 #include "carl/jit2/codegen2.h"
 #include "carl/ast/ast_printer.h"
+#include "carl/ast/type_inference.h"
 
+#include "carl/jit2/runtime_bitcode.h"
 #include "carl/jit2/runtime_types.h"
 
 using namespace carl;
@@ -64,6 +67,1096 @@ TEST(codegen2, fn_mania) {
     ASSERT_EQ(result, 4 + 5);
 }
 
+TEST(codegen2, lazy_compilation) {
+    CarlJIT jit(CarlJITOptions{.lazy = true});
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "let two = 2;"
+        "fn never_called(s: string): string {"
+        "   return s + \"!\";"
+        "}"
+        "fn foo(a: int): (:int) {"
+        "   let one = 1;"
+        "   fn bar() : int {"
+        "       return a + one + two;"
+        "   }"
+        "   return bar;"
+        "}"
+        "let bar_1 = foo(1);"
+        "let bar_2 = foo(2);"
+        "return bar_1() + bar_2();";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    ASSERT_TRUE(jit.load_module(module));
+    ASSERT_FALSE(jit.is_compiled("__carl_main"));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 4 + 5);
+    ASSERT_TRUE(jit.is_compiled("__carl_main"));
+    ASSERT_TRUE(jit.is_compiled("bar_impl"));
+    ASSERT_FALSE(jit.is_compiled("never_called_impl"));
+}
+
+TEST(codegen2, tiered_compilation) {
+    CarlJITOptions options;
+    options.tiered = true;
+    options.tier_up_threshold = 2;
+    CarlJIT jit(options);
+    Parser p;
+
+    /* Tier 0 is unoptimized, at O2 the calls of bar_3 are folded away */
+    Codegen2 cg;
+    cg.set_tiered(true);
+    cg.init("main");
+
+    std::string src = ""
+        "fn foo(a: int): (:int) {"
+        "   fn bar() : int {"
+        "       return a * 2 + 1;"
+        "   }"
+        "   return bar;"
+        "}"
+        "let bar_3 = foo(3);"
+        "return bar_3() + bar_3() + bar_3() + bar_3();";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    ASSERT_TRUE(jit.load_module(module));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 4 * 7);
+
+    /* Only bar_impl got hot */
+    jit.wait_for_tier_ups();
+    auto stats = jit.get_tiering_stats();
+    ASSERT_EQ(stats.num_requests, 1);
+    ASSERT_EQ(stats.num_tier_ups, 1);
+    ASSERT_EQ(stats.num_failures, 0);
+
+    auto slot = jit.lookup_ea("bar_impl.slot")->toPtr<void**>();
+    ASSERT_EQ(*slot, jit.lookup_ea("bar_impl.tier1")->toPtr<void*>());
+
+    /* Now running the optimized bar_impl */
+    ASSERT_EQ(__main(), 4 * 7);
+}
+
+TEST(codegen2, tiered_compilation_of_loops) {
+    CarlJITOptions options;
+    options.tiered = true;
+    options.tier_up_threshold = 100;
+    CarlJIT jit(options);
+    Parser p;
+
+    Codegen2 cg;
+    cg.set_tiered(true);
+    cg.init("main");
+
+    /* sum_to is called once, main not at all: only their loops make them hot */
+    std::string src = ""
+        "fn sum_to(n: int): int {"
+        "   let sum = 0;"
+        "   let i = 0;"
+        "   while (i < n) {"
+        "       sum = sum + i;"
+        "       i = i + 1;"
+        "   }"
+        "   return sum;"
+        "}"
+        "let total = 0;"
+        "let j = 0;"
+        "while (j < 1000) {"
+        "   total = total + j;"
+        "   j = j + 1;"
+        "}"
+        "return total + sum_to(1000);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    ASSERT_TRUE(jit.load_module(module));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 2 * 499500);
+
+    jit.wait_for_tier_ups();
+    auto stats = jit.get_tiering_stats();
+    ASSERT_EQ(stats.num_requests, 2);
+    ASSERT_EQ(stats.num_tier_ups, 2);
+    ASSERT_EQ(stats.num_failures, 0);
+
+    auto sum_to_slot = jit.lookup_ea("sum_to_impl.slot")->toPtr<void**>();
+    ASSERT_EQ(*sum_to_slot, jit.lookup_ea("sum_to_impl.tier1")->toPtr<void*>());
+    auto main_slot = jit.lookup_ea("__carl_main.slot")->toPtr<void**>();
+    ASSERT_EQ(*main_slot, jit.lookup_ea("__carl_main.tier1")->toPtr<void*>());
+
+    /* Forwarded to the optimized __carl_main */
+    ASSERT_EQ(__main(), 2 * 499500);
+}
+
+TEST(codegen2, tiered_modules_keep_their_helpers_apart) {
+    CarlJITOptions options;
+    options.tiered = true;
+    CarlJIT jit(options);
+    Parser p;
+    TypeInference type_inference;
+    Codegen2 cg;
+    cg.set_tiered(true);
+    cg.set_incremental(true);
+
+    /* Both modules have a string constant and a composition_impl. The tokens
+     * of the session point into the sources. */
+    std::deque<std::string> sources;
+    for (std::string name : {"a", "b"}) {
+        std::string& src = sources.emplace_back() = ""
+            "fn inc_" + name + "(a: int): int { return a + 1; }"
+            "let inc2_" + name + " = inc_" + name + " . inc_" + name + ";"
+            "let s_" + name + " = \"" + name + "\";"
+            "return inc2_" + name + "(1);";
+        auto decls = p.parse_r(src, false, true);
+        ASSERT_TRUE(decls);
+        ASSERT_TRUE(type_inference.run(*decls));
+        cg.init(name);
+        auto module = cg.generate(*decls);
+        std::string main_name = module.get_main_name();
+        ASSERT_TRUE(jit.load_module(module));
+        auto main = jit.lookup_ea(main_name.c_str());
+        ASSERT_TRUE(main);
+        ASSERT_EQ(main->toPtr<uint64_t()>()(), 3);
+    }
+}
+
+TEST(codegen2, opt_levels) {
+    std::string src = ""
+        "let two = 2;"
+        "fn foo(a: int): (:int) {"
+        "   let one = 1;"
+        "   fn bar() : int {"
+        "       return a * two + one;"
+        "   }"
+        "   return bar;"
+        "}"
+        "let bar_3 = foo(3);"
+        "return bar_3() + bar_3();";
+
+    for (auto level : {OptLevel::O0, OptLevel::O1, OptLevel::O2, OptLevel::O3, OptLevel::Os}) {
+        CarlJIT jit(CarlJITOptions{.opt_level = level});
+        Parser p;
+        auto decls = p.parse_r(src, false);
+
+        Codegen2 cg;
+        cg.set_opt_level(level);
+        cg.init("main");
+        auto module = cg.generate(*decls);
+        auto tsm = module.take_llvm_module();
+
+        /* Everything but O0 promotes the locals to registers */
+        size_t num_allocas = 0;
+        tsm.withModuleDo([&](llvm::Module& m) {
+            for (auto& bb : *m.getFunction("bar_impl")) {
+                for (auto& inst : bb) num_allocas += llvm::isa<llvm::AllocaInst>(inst);
+            }
+        });
+        if (level == OptLevel::O0) {
+            ASSERT_GT(num_allocas, 0) << opt_level_name(level);
+        } else {
+            ASSERT_EQ(num_allocas, 0) << opt_level_name(level);
+        }
+
+        Codegen2Module optimized(std::move(tsm));
+        ASSERT_TRUE(jit.load_module(optimized));
+        auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+        ASSERT_EQ(__main(), 2 * 7) << opt_level_name(level);
+    }
+}
+
+TEST(codegen2, parallel_compilation) {
+    std::string src = ""
+        "let two = 2;"
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "fn mul(a: int, b: int): int {"
+        "   return a * b;"
+        "}"
+        "fn greet(name: string): string {"
+        "   return \"hello \" + name;"
+        "}"
+        "fn foo(a: int): (:int) {"
+        "   fn bar() : int {"
+        "       return a * two + 1;"
+        "   }"
+        "   return bar;"
+        "}"
+        "let bar_3 = foo(3);"
+        "let greeting = greet(\"carl\");"
+        "return add(bar_3(), mul(bar_3(), 1));";
+
+    for (bool gc : {false, true}) {
+        CarlJIT jit(CarlJITOptions{.gc = gc, .compile_threads = 4});
+        Parser p;
+        auto decls = p.parse_r(src, false);
+
+        Codegen2 cg;
+        cg.set_gc(gc);
+        cg.init("main");
+        auto module = cg.generate(*decls);
+
+        ASSERT_TRUE(jit.load_module(module));
+        auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+        ASSERT_EQ(__main(), 2 * 7);
+    }
+}
+
+TEST(codegen2, direct_calls) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.set_opt_level(OptLevel::O0);  // check the calls as generated
+    cg.init("main");
+
+    std::string src = ""
+        "let two = 2;"
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "fn add_two(a: int): int {"
+        "   return a + two;"
+        "}"
+        "fn foo(a: int): (:int) {"
+        "   fn bar() : int {"
+        "       return add(a, 1);"
+        "   }"
+        "   return bar;"
+        "}"
+        "let bar_3 = foo(3);"
+        "return add(add_two(1), bar_3());";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+
+    /* Only the call through the returned closure stays indirect */
+    size_t num_indirect_calls = 0;
+    tsm.withModuleDo([&](llvm::Module& m) {
+        for (auto& fn : m) {
+            for (auto& bb : fn) {
+                for (auto& inst : bb) {
+                    auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                    if (call && call->isIndirectCall()) num_indirect_calls++;
+                }
+            }
+        }
+    });
+    ASSERT_EQ(num_indirect_calls, 1);
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 3 + 4);
+    // only bar escapes, its crt_fn and captures are one object
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 1);
+}
+
+TEST(codegen2, non_escaping_closures_on_stack) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn outer(a: int): int {"
+        "   fn helper(b: int): int {"
+        "       return a + b;"
+        "   }"
+        "   return helper(1) + helper(2);"
+        "}"
+        "fn make_adder(a: int): (:int) {"
+        "   fn add_a(): int {"
+        "       return a + 10;"
+        "   }"
+        "   return add_a;"
+        "}"
+        "let adder = make_adder(1);"
+        "return outer(1) + outer(2) + adder();";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 5 + 7 + 11);
+    // only the returned add_a needs its closure on the heap
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 1);
+}
+
+TEST(codegen2, partial_application_is_specialised) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "let add_two = add(_, 2);"
+        "return add_two(1) + add_two(3);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        /* The constant closure is folded, add_two(1) + add_two(3) is 8 */
+        llvm::Function* main = m.getFunction("__carl_main");
+        for (auto& bb : *main) {
+            for (auto& inst : bb) ASSERT_FALSE(llvm::isa<llvm::CallInst>(inst));
+        }
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 3 + 5);
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 0);
+}
+
+TEST(codegen2, gc_partial_application_captures) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    /* Bound values and closures with captures are captured, closures that are
+     * not statically known are called through their crt_fn. */
+    std::string src = ""
+        "fn join(a: string, b: string, c: string): string {"
+        "   return a + b + c;"
+        "}"
+        "fn apply(f: (string : string), s: string): string {"
+        "   let g = f(_);"
+        "   return g(s);"
+        "}"
+        "fn make(prefix: string): (string : string) {"
+        "   let sep = \", \";"
+        "   fn greet(name: string, end: string): string {"
+        "       return prefix + sep + name + end;"
+        "   }"
+        "   return greet(_, \"!\");"
+        "}"
+        "let middle = \"carl\" + \" and \";"
+        "let around = join(_, middle, _);"
+        "let hello = make(\"hello\");"
+        "return apply(hello, around(\"alice \", \"bob\"));";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello, alice carl and bob!");
+}
+
+TEST(codegen2, composition_is_fused) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn inc(a: int): int {"
+        "   return a + 1;"
+        "}"
+        "fn mul(a: int, b: int): int {"
+        "   return a * b;"
+        "}"
+        "let h = inc . mul(_, 3) . inc;"
+        "return h(1) + h(2);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        /* No intermediate closures, everything is inlined and folded */
+        llvm::Function* main = m.getFunction("__carl_main");
+        for (auto& bb : *main) {
+            for (auto& inst : bb) ASSERT_FALSE(llvm::isa<llvm::CallInst>(inst));
+        }
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 7 + 10);
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 0);
+}
+
+TEST(codegen2, constants_are_folded_before_codegen) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_opt_level(OptLevel::O0);
+
+    std::string src = ""
+        "fn square(x: int): int {"
+        "   return x * x;"
+        "}"
+        "fn inc(x: int): int {"
+        "   return x + 1;"
+        "}"
+        "let limit = 10 * 10;"
+        "let f = square . inc;"
+        "let n = 0;"
+        "while (n < limit) {"
+        "   n = n + 1;"
+        "}"
+        "while (limit < 0) {"
+        "   n = n - 1;"
+        "}"
+        "return f(n) + -(2 - 5);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        /* Even without llvm's passes: one loop, no arithmetic on constants and
+         * f(n) calls the stages directly */
+        llvm::Function* main = m.getFunction("__carl_main");
+        size_t num_loops = 0;
+        for (auto& bb : *main) {
+            num_loops += bb.getName().startswith("while_cond");
+            for (auto& inst : bb) {
+                ASSERT_NE(inst.getOpcode(), llvm::Instruction::Mul);
+                ASSERT_NE(inst.getOpcode(), llvm::Instruction::Sub);
+                if (auto* call = llvm::dyn_cast<llvm::CallInst>(&inst)) ASSERT_TRUE(call->getCalledFunction());
+            }
+        }
+        ASSERT_EQ(num_loops, 1);
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 10201 + 3);
+}
+
+TEST(codegen2, gc_composition_with_closures) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    /* Stages with captures and stages that are not statically known */
+    std::string src = ""
+        "fn exclaim(s: string): string {"
+        "   return s + \"!\";"
+        "}"
+        "fn twice(f: (string : string)): (string : string) {"
+        "   return f . f;"
+        "}"
+        "fn greeter(greeting: string): string {"
+        "   let sep = \" \";"
+        "   fn greet(name: string): string {"
+        "       return greeting + sep + name;"
+        "   }"
+        "   let shout = twice(exclaim);"
+        "   let run = shout . greet;"
+        "   return run(\"carl\");"
+        "}"
+        "return greeter(\"hello\" + \",\");";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello, carl!!");
+}
+
+TEST(codegen2, tail_calls) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+    cg.set_opt_level(OptLevel::O0);  // check the calls as generated
+
+    std::string src = ""
+        "fn forever(n: int, acc: int): int {"
+        "   return forever(n - 1, acc + n);"
+        "}"
+        "fn step(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "fn relay(a: int, b: int): int {"
+        "   return step(a * 2, b);"
+        "}"
+        "fn wrap(a: int): int {"
+        "   return relay(a, 1);"
+        "}"
+        "return wrap(20);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        auto calls_of = [](llvm::Function* fn) {
+            std::vector<llvm::CallInst*> calls;
+            for (auto& bb : *fn) {
+                for (auto& inst : bb) {
+                    auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                    if (call && call->getCalledFunction() && call->getCalledFunction()->getName().endswith("_impl")) {
+                        calls.push_back(call);
+                    }
+                }
+            }
+            return calls;
+        };
+        /* Self recursion is a loop */
+        ASSERT_EQ(calls_of(m.getFunction("forever_impl")).size(), 0);
+        /* Same prototype, guaranteed */
+        auto relay_calls = calls_of(m.getFunction("relay_impl"));
+        ASSERT_EQ(relay_calls.size(), 1);
+        ASSERT_TRUE(relay_calls[0]->isMustTailCall());
+        auto wrap_calls = calls_of(m.getFunction("wrap_impl"));
+        ASSERT_EQ(wrap_calls.size(), 1);
+        ASSERT_TRUE(wrap_calls[0]->isTailCall());
+        ASSERT_FALSE(wrap_calls[0]->isMustTailCall());
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 41);
+}
+
+TEST(codegen2, while_loops) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_opt_level(OptLevel::O0);  // check the loop as generated
+
+    std::string src = ""
+        "fn sum_to(n: int): int {"
+        "   let sum = 0;"
+        "   let i = 0;"
+        "   while (i < n) {"
+        "       let j = 0;"
+        "       while (j <= i) {"
+        "           sum = sum + j;"
+        "           j = j + 1;"
+        "       }"
+        "       i = i + 1;"
+        "   }"
+        "   return sum;"
+        "}"
+        "let done = sum_to(0) == 0;"
+        "let rounds = 0;"
+        "while (done) {"
+        "   rounds = rounds + 1;"
+        "   done = rounds < 3;"
+        "}"
+        "return sum_to(100) + rounds;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        /* All locals are in the entry block, the loop does not grow the
+         * stack */
+        llvm::Function* sum_to = m.getFunction("sum_to_impl");
+        size_t num_allocas = 0;
+        for (auto& bb : *sum_to) {
+            for (auto& inst : bb) {
+                if (llvm::isa<llvm::AllocaInst>(inst)) {
+                    ASSERT_EQ(&bb, &sum_to->getEntryBlock());
+                    num_allocas++;
+                }
+            }
+        }
+        ASSERT_EQ(num_allocas, 4);
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 166650 + 3);
+}
+
+TEST(codegen2, gc_while_loop_with_strings) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    std::string src = ""
+        "fn wrap(s: string): string {"
+        "   return \"(\" + s + \")\";"
+        "}"
+        "let s = \"carl\";"
+        "let i = 0;"
+        "while (i < 3) {"
+        "   s = wrap(s);"
+        "   i = i + 1;"
+        "}"
+        "return s;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "(((carl)))");
+}
+
+TEST(codegen2, gc_while_loop_collects_without_calls) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    std::string src = ""
+        "let s = \"\";"
+        "let i = 0;"
+        "while (i < 100) {"
+        "   s = s + \"a\";"
+        "   i = i + 1;"
+        "}"
+        "return s;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_EQ(std::string(result->data), std::string(100, 'a'));
+    ASSERT_GT(jit.get_gc_stats().objects_freed, 0);
+}
+
+TEST(codegen2, arrays) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn sum(a: [int]): int {"
+        "   let s = 0;"
+        "   let i = 0;"
+        "   while (i < len(a)) {"
+        "       s = s + a[i];"
+        "       i = i + 1;"
+        "   }"
+        "   return s;"
+        "}"
+        "let a = [0; 1000];"
+        "let i = 0;"
+        "while (i < len(a)) {"
+        "   a[i] = i;"
+        "   i = i + 1;"
+        "}"
+        "let small = [1, 2, 3];"
+        "small[1] = 20;"
+        "let halves = [0.5; 4];"
+        "let nested = [small, [4, 5]];"
+        "return sum(a) + sum(small) + nested[1][0] + len(halves);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        /* The elements are one block, indexing is a gep into it */
+        llvm::Function* sum = m.getFunction("sum_impl");
+        size_t num_calls = 0;
+        for (auto& bb : *sum) {
+            for (auto& inst : bb) {
+                if (auto* call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+                    ASSERT_EQ(call->getCalledFunction()->getName(), "crt_array__index_error");
+                    num_calls++;
+                }
+            }
+        }
+        ASSERT_LE(num_calls, 1);
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 499500 + 24 + 4 + 4);
+}
+
+TEST(codegen2, array_index_out_of_bounds) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "let a = [1, 2, 3];"
+        "let i = 0 - 1;"
+        "return a[1] + a[len(a) + i] + a[len(a)];";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    EXPECT_DEATH(__main(), "index 3 out of bounds for array of length 3");
+}
+
+TEST(codegen2, gc_arrays_of_strings) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    /* Only reachable through the arrays */
+    std::string src = ""
+        "fn wrap(s: string): string {"
+        "   return \"(\" + s + \")\";"
+        "}"
+        "let words = [\"a\"; 3];"
+        "let i = 0;"
+        "while (i < len(words)) {"
+        "   words[i] = wrap(words[i] + \"b\");"
+        "   i = i + 1;"
+        "}"
+        "let nested = [words, [\"c\" + \"d\"]];"
+        "let other = wrap(\"x\");"
+        "return nested[0][2] + nested[1][0] + other;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "(ab)cd(x)");
+}
+
+TEST(codegen2, array_pipelines_are_fused) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn square(x: int): int {"
+        "   return x * x;"
+        "}"
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "fn apply(f: (int : int), a: [int]): [int] {"
+        "   return map(f, a);"
+        "}"
+        "let numbers = [0; 1000];"
+        "let i = 0;"
+        "while (i < len(numbers)) {"
+        "   numbers[i] = i;"
+        "   i = i + 1;"
+        "}"
+        "let limit = 500;"
+        "fn small(x: int): bool {"
+        "   return x < limit;"
+        "}"
+        "let total = fold(add, 0, map(square, filter(small, numbers)));"
+        "let squares = map(square, filter(small, numbers));"
+        "let shifted = apply(add(_, 1), numbers);"
+        "return total + len(squares) + squares[499] + shifted[999];";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 41541750 + 500 + 249001 + 1000);
+    /* numbers, squares and shifted (header and data each) and the crt_fn of
+     * small, nothing for the inner stages */
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 3 * 2 + 1);
+}
+
+TEST(codegen2, gc_array_pipeline_with_closures) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    std::string src = ""
+        "fn decorate(words: [string], suffix: string): string {"
+        "   fn add_suffix(w: string): string {"
+        "       return w + suffix;"
+        "   }"
+        "   fn join(acc: string, w: string): string {"
+        "       return acc + w;"
+        "   }"
+        "   return fold(join, \"\", map(add_suffix, words));"
+        "}"
+        "fn exclaim(w: string): string {"
+        "   return w + \"!\";"
+        "}"
+        "let words = map(exclaim, [\"a\", \"b\", \"c\"]);"
+        "return decorate(words, \"?\" + \"?\");";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "a!??b!??c!??");
+}
+
+TEST(codegen2, par_map_and_par_reduce) {
+    CarlJIT jit(CarlJITOptions{.parallel_threads = 4});
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn square(x: int): int {"
+        "   return x * x;"
+        "}"
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "fn exclaim(w: string): string {"
+        "   return w + \"!\";"
+        "}"
+        "fn negative(x: int): bool {"
+        "   return x < 0;"
+        "}"
+        "let numbers = [0; 100000];"
+        "let i = 0;"
+        "while (i < len(numbers)) {"
+        "   numbers[i] = i;"
+        "   i = i + 1;"
+        "}"
+        "let squares = par_map(square, numbers);"
+        "let words = par_map(exclaim, [\"a\"; 1000]);"
+        "let empty = par_reduce(add, 7, filter(negative, numbers));"
+        "return par_reduce(add, 0, squares) + squares[99999] + len(words) + empty;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 333328333350000 + 9999800001 + 1000 + 7);
+    ASSERT_EQ(jit.get_thread_pool().get_num_threads(), 4);
+    ASSERT_EQ(jit.get_thread_pool_stats().num_jobs, 3);
+}
+
+TEST(codegen2, par_map_with_captures) {
+    CarlJIT jit(CarlJITOptions{.parallel_threads = 4});
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "fn shifted(numbers: [int], k: int): int {"
+        "   fn add_k(x: int): int {"
+        "       return x + k;"
+        "   }"
+        "   return par_reduce(add, 0, par_map(add_k, numbers));"
+        "}"
+        "return shifted([1; 100], 100);";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 100 * 101);
+}
+
+TEST(codegen2, par_map_int_to_float) {
+    CarlJIT jit(CarlJITOptions{.parallel_threads = 4});
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn add(a: float, b: float): float {"
+        "   return a + b;"
+        "}"
+        "fn half(x: int): float {"
+        "   let f = 0.0;"
+        "   let i = 0;"
+        "   while (i < x) {"
+        "       f = f + 0.5;"
+        "       i = i + 1;"
+        "   }"
+        "   return f;"
+        "}"
+        "return par_reduce(add, 0.0, par_map(half, [3; 10]));";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<double()>();
+    ASSERT_EQ(__main(), 15.0);
+}
+
+TEST(codegen2, par_reduce_applies_init_once) {
+    Parser p;
+    std::string src = ""
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "let numbers = [1; 5000];"
+        "return par_reduce(add, 10, numbers) * 100000 + fold(add, 10, numbers);";
+    auto decls = p.parse_r(src, false);
+
+    /* One chunk per 1024 elements in arena mode, a single one with gc */
+    for (bool gc : {false, true}) {
+        CarlJIT jit(CarlJITOptions{.gc = gc, .parallel_threads = 4});
+        Codegen2 cg;
+        cg.init("main");
+        cg.set_gc(gc);
+        auto module = cg.generate(*decls);
+        jit.load_module(module);
+        auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+        ASSERT_EQ(__main(), 5010 * 100000 + 5010);
+    }
+}
+
+TEST(codegen2, gc_par_map_with_strings) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    std::string src = ""
+        "fn exclaim(w: string): string {"
+        "   return w + \"!\";"
+        "}"
+        "fn join(a: string, b: string): string {"
+        "   return a + b;"
+        "}"
+        "return par_reduce(join, \"\", par_map(exclaim, [\"a\", \"b\" + \"c\", \"d\"]));";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "a!bc!d!");
+    /* Runs on the calling thread, the pool is never started */
+    ASSERT_EQ(jit.get_thread_pool_stats().num_jobs, 0);
+}
+
+TEST(codegen2, gc_non_escaping_closure_with_string_capture) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    std::string src = ""
+        "fn greet(name: string): string {"
+        "   let greeting = \"hello \" + name;"
+        "   fn twice(): string {"
+        "       return greeting + greeting;"
+        "   }"
+        "   return twice();"
+        "}"
+        "return greet(\"carl\" + \"!\");";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello carl!hello carl!");
+}
+
+TEST(codegen2, gc_traces_typed_captures) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    /* The string sits between int captures, only its word may be traced */
+    std::string src = ""
+        "fn second(a: int, s: string, b: int): string {"
+        "   return s + \"!\";"
+        "}"
+        "fn make(a: int, name: string, b: int): (:string) {"
+        "   let greeting = \"hi \" + name;"
+        "   fn get(): string {"
+        "       return second(a, greeting, b);"
+        "   }"
+        "   return get;"
+        "}"
+        "let get = make(1, \"carl\" + \"a\", 2);"
+        "let other = \"x\" + \"y\";"
+        "return get();";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hi carla!");
+}
+
 TEST(codegen2, string_fndecl_with_capture) {
     CarlJIT jit;
     Parser p;
@@ -132,6 +1225,133 @@ TEST(codegen2, string_concat) {
     ASSERT_EQ(result->len, 13);
 }
 
+TEST(codegen2, string_concat_chain) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "let name = \"carl\";"
+        "name = \"carl\";"  // assigned, so it is not folded into the chains
+        "let greeting = \"hello\" + \", \" + name;"
+        "return greeting + \" and \" + (name + \"!\");";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello, carl and carl!");
+    ASSERT_EQ(result->len, 22);
+    // one crt_string and one buffer per chain
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 2 * 2);
+}
+
+TEST(codegen2, string_append_in_loop_is_linear) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "let s = \"\";"
+        "let i = 0;"
+        "while (i < 10000) {"
+        "   s = s + \"ab\";"
+        "   i = i + 1;"
+        "}"
+        "return s;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    std::string expected;
+    for (int i = 0; i < 10000; ++i) expected += "ab";
+    ASSERT_EQ(std::string(result->data), expected);
+    ASSERT_EQ(result->len, 20001);
+    // the buffer doubles, copying every + would allocate 10000 * 2 times
+    // and about 100MB
+    ArenaStats stats = jit.get_heap_stats();
+    ASSERT_LT(stats.num_allocations, 2 * 20);
+    ASSERT_LT(stats.bytes_allocated, 8 * result->len);
+}
+
+TEST(codegen2, string_append_keeps_other_references) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "let s = \"x\";"
+        "let t = \"\";"
+        "let i = 0;"
+        "while (i < 3) {"
+        "   s = s + \"a\";"
+        "   t = s;"
+        "   s = s + \"b\";"
+        "   i = i + 1;"
+        "}"
+        "return t;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "xababa");
+    ASSERT_EQ(result->len, 7);
+}
+
+TEST(codegen2, runtime_helpers_are_inlined) {
+    if (!has_runtime_bitcode()) GTEST_SKIP() << "built without the runtime bitcode";
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn greet(name: string): string {"
+        "   return \"hello \" + name;"
+        "}"
+        "let squares = [0; 3];"
+        "return greet(\"carl\");";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+    auto tsm = module.take_llvm_module();
+    tsm.withModuleDo([](llvm::Module& m) {
+        /* Only the allocations are left as calls into the host */
+        for (auto& fn : m) {
+            for (auto& bb : fn) {
+                for (auto& inst : bb) {
+                    auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                    if (!call || !call->getCalledFunction()) continue;
+                    ASSERT_NE(call->getCalledFunction()->getName(), "crt_string__concat");
+                    ASSERT_NE(call->getCalledFunction()->getName(), "crt_array__new");
+                }
+            }
+        }
+    });
+
+    Codegen2Module generated(std::move(tsm));
+    ASSERT_TRUE(jit.load_module(generated));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello carl");
+    ASSERT_EQ(result->len, 11);
+}
+
 TEST(codegen2, string_create) {
     CarlJIT jit;
     Parser p;
@@ -152,6 +1372,34 @@ TEST(codegen2, string_create) {
     ASSERT_EQ(result->len, 13);
 }
 
+TEST(codegen2, string_literal_is_not_allocated) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn hello(): string {"
+        "   return \"hello world!\";"
+        "}"
+        "let a = hello();"
+        "return hello();";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* first = __main();
+    crt_string* second = __main();
+    ASSERT_STREQ(first->data, "hello world!");
+    ASSERT_EQ(first->len, 13);
+    ASSERT_EQ(first, second);
+    // hello does not escape, so even its crt_fn is on the stack
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 0);
+}
+
 TEST(codegen2, basic_expression_add) {
     CarlJIT jit;
     Parser p;
@@ -169,4 +1417,72 @@ TEST(codegen2, basic_expression_add) {
     auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
     ASSERT_EQ(__main(), 3);
 }
+
+TEST(codegen2, heap_reset_after_run) {
+    CarlJIT jit;
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+
+    std::string src = ""
+        "fn greet(greeting: string): string {"
+        "   return greeting + \"world!\";"
+        "}"
+        "return greet(\"hello \");";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello world!");
+    ASSERT_GT(jit.get_heap_stats().num_allocations, 0);
+
+    ArenaStats run = jit.reset_heap();
+    ASSERT_GT(run.bytes_allocated, 0);
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, 0);
+
+    __main();
+    ASSERT_EQ(jit.get_heap_stats().num_allocations, run.num_allocations);
+}
+
+TEST(codegen2, gc_keeps_rooted_strings) {
+    CarlJIT jit(CarlJITOptions{.gc = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+    Parser p;
+
+    Codegen2 cg;
+    cg.init("main");
+    cg.set_gc(true);
+
+    std::string src = ""
+        "fn greet(name: string): string {"
+        "   return \"hello \" + name;"
+        "}"
+        "let a = greet(\"a\");"
+        "let b = greet(\"b\" + \"!\");"
+        "return a + b;";
+    auto decls = p.parse_r(src, false);
+
+    auto module = cg.generate(*decls);
+
+    jit.load_module(module);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    crt_string* result = __main();
+    ASSERT_STREQ(result->data, "hello ahello b!");
+    ASSERT_GE(jit.get_gc_stats().num_collections, 3);
+
+    // the result is still referenced by the host
+    jit.get_gc_heap()->add_root((void**)&result);
+    jit.collect_garbage();
+    ASSERT_STREQ(result->data, "hello ahello b!");
+    ASSERT_EQ(jit.get_gc_stats().objects_live, 2);
+
+    jit.get_gc_heap()->remove_root((void**)&result);
+    jit.collect_garbage();
+    ASSERT_EQ(jit.get_gc_stats().objects_live, 0);
+    ASSERT_EQ(jit.get_gc_stats().objects_freed, jit.get_gc_stats().num_allocations);
+}
 }
@@ -0,0 +1,87 @@
+#include "carl/ast/constant_folding.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <vector>
+
+#include "carl/ast/print_visitor.h"
+#include "carl/parser.h"
+
+using namespace carl;
+
+namespace {
+
+/* Folds src and prints the top level declarations that are left. */
+std::vector<std::string> fold(std::string src) {
+    Parser parser;
+    ParseResult r = parser.parse_r(src, false);
+    EXPECT_TRUE(r);
+    auto decls = *r;
+    ConstantFolding folding;
+    folding.run(decls);
+
+    std::vector<std::string> printed;
+    for (auto& decl : decls) {
+        std::ostringstream ss;
+        PrintAstNodeVisitor v(ss);
+        decl->accept(&v);
+        printed.push_back(ss.str());
+    }
+    return printed;
+}
+
+TEST(ConstantFolding, arithmetic_and_lets) {
+    auto decls = fold(
+        "let width = 2 + 3;"
+        "let area = width * width - -1;"
+        "let half = 7.0 / 2.0;"
+        "let big = !(area < 20);"
+        "let i = 0;"
+        "i = i + width;");
+    std::vector<std::string> expected = {
+        "let width = 5;", "let area = 26;", "let half = 3.5;", "let big = true;", "let i = 0;", "(= i (+ i 5));",
+    };
+    ASSERT_EQ(decls, expected);
+}
+
+TEST(ConstantFolding, runtime_errors_are_not_folded) {
+    auto decls = fold("let a = 1 / 0; let b = 1.0 / 0.0;");
+    std::vector<std::string> expected = {"let a = (/ 1 0);", "let b = (/ 1.0 0.0);"};
+    ASSERT_EQ(decls, expected);
+}
+
+TEST(ConstantFolding, string_literals_are_joined) {
+    auto decls = fold(
+        "let name = \"carl\";"
+        "let other = \"you\";"
+        "other = \"them\";"
+        "let greeting = \"hello \" + name + \" and \" + other + \"!\" + \"!\";");
+    ASSERT_EQ(decls[3], "let greeting = (+ (+ \"hello carl and \" other) \"!!\");");
+}
+
+TEST(ConstantFolding, dead_loops_are_dropped) {
+    auto decls = fold(
+        "let limit = 10;"
+        "let i = 0;"
+        "while (limit < 5) { i = i + 1; }"
+        "while (i < limit) { i = i + 1; }");
+    ASSERT_EQ(decls.size(), 3);
+}
+
+TEST(ConstantFolding, folded_tokens_own_their_text) {
+    std::shared_ptr<Expression> initializer;
+    {
+        std::string src = "let s = \"ab\" + \"cd\";";
+        Parser parser;
+        auto decls = *parser.parse_r(src, false);
+        ConstantFolding folding;
+        folding.run(decls);
+        initializer = std::static_pointer_cast<LetDecl>(decls[0])->get_initializer();
+    }
+    /* The source, the rest of the ast and the pass are gone */
+    ASSERT_EQ(initializer->get_node_type(), AstNodeType::String);
+    ASSERT_EQ(std::string(std::static_pointer_cast<String>(initializer)->get_value()), "\"abcd\"");
+}
+
+}  // namespace
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "carl/jit2/carljit.h"
+#include "carl/jit2/codegen2.h"
+#include "carl/jit2/runtime_types.h"
+#include "carl/parser.h"
+
+using namespace carl;
+
+namespace {
+
+Codegen2Module generate(std::string src, bool gc = false) {
+    Parser p;
+    auto decls = p.parse_r(src, false);
+
+    Codegen2 cg;
+    cg.init("rules");
+    cg.set_gc(gc);
+    cg.set_hot_reload(true);
+    return cg.generate(*decls);
+}
+
+std::string rules(const char* price) {
+    return std::string("") +
+        "fn price(x: int): int {"
+        "   return " + price + ";"
+        "}"
+        "fn tax(x: int): int {"
+        "   return x + x / 10;"
+        "}"
+        "let p = price;"
+        "return tax(price(100)) + p(1);";
+}
+
+TEST(HotReload, only_changed_functions_are_compiled) {
+    CarlJIT jit(CarlJITOptions{.hot_reload = true});
+
+    auto v1 = generate(rules("x * 2"));
+    auto stats = jit.reload_module(v1);
+    ASSERT_TRUE(stats);
+    ASSERT_EQ(stats->num_compiled, 3);
+    ASSERT_EQ(stats->num_unchanged, 0);
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 220 + 2);
+
+    /* The crt_fn in p and the direct call both get the new price */
+    auto v2 = generate(rules("x * 3"));
+    stats = jit.reload_module(v2);
+    ASSERT_TRUE(stats);
+    ASSERT_EQ(stats->num_compiled, 1);
+    ASSERT_EQ(stats->num_unchanged, 2);
+    ASSERT_EQ(stats->num_removed, 1);
+    ASSERT_EQ(__main(), 330 + 3);
+
+    auto v3 = generate(rules("x * 3"));
+    stats = jit.reload_module(v3);
+    ASSERT_TRUE(stats);
+    ASSERT_EQ(stats->num_compiled, 0);
+    ASSERT_EQ(__main(), 330 + 3);
+}
+
+TEST(HotReload, new_functions_and_signatures) {
+    CarlJIT jit(CarlJITOptions{.hot_reload = true});
+
+    auto v1 = generate("fn f(x: int): int { return x + 1; } return f(1);");
+    ASSERT_TRUE(jit.reload_module(v1));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+    ASSERT_EQ(__main(), 2);
+
+    /* f changes its signature, its caller is compiled again with it */
+    auto v2 = generate(""
+        "fn g(x: int): int { return x * 10; }"
+        "fn f(x: int, y: int): int { return g(x) + y; }"
+        "return f(1, 2);");
+    auto stats = jit.reload_module(v2);
+    ASSERT_TRUE(stats);
+    ASSERT_EQ(stats->num_compiled, 3);
+    ASSERT_EQ(__main(), 12);
+}
+
+TEST(HotReload, gc_root_chain_is_shared) {
+    CarlJIT jit(CarlJITOptions{.gc = true, .hot_reload = true});
+    jit.get_gc_heap()->set_threshold(0);  // collect at every safepoint
+
+    auto script = [](const char* greeting) {
+        return std::string("") +
+            "fn greet(name: string): string {"
+            "   return \"" + greeting + " \" + name + \"!\";"
+            "}"
+            "let name = \"carl\";"
+            "name = name + \"a\";"
+            "return greet(name);";
+    };
+    auto v1 = generate(script("hello"), true);
+    ASSERT_TRUE(jit.reload_module(v1));
+    auto __main = jit.lookup_ea("__carl_main")->toPtr<crt_string*()>();
+    ASSERT_STREQ(__main()->data, "hello carla!");
+
+    auto v2 = generate(script("bye"), true);
+    auto stats = jit.reload_module(v2);
+    ASSERT_TRUE(stats);
+    ASSERT_EQ(stats->num_compiled, 1);
+    ASSERT_STREQ(__main()->data, "bye carla!");
+    ASSERT_GT(jit.get_gc_stats().num_collections, 0);
+}
+
+TEST(HotReload, needs_the_option) {
+    CarlJIT jit;
+    auto module = generate("return 1;");
+    ASSERT_FALSE(jit.reload_module(module));
+}
+
+}  // namespace
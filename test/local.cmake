@@ -12,7 +12,14 @@ set(TEST_CC
     test/scanner_test.cc
     test/util_test.cc
     test/parser_test.cc
+    test/constant_folding_test.cc
     test/codegen2_test.cc
+    test/arena_test.cc
+    test/thread_pool_test.cc
+    test/object_cache_test.cc
+    test/aot_test.cc
+    test/hot_reload_test.cc
+    test/repl_test.cc
     test/polymorphic_types_test.cc
 )
 
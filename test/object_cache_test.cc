@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "carl/jit2/carljit.h"
+#include "carl/jit2/codegen2.h"
+#include "carl/jit2/object_cache.h"
+#include "carl/parser.h"
+#include "llvm/Support/FileSystem.h"
+
+using namespace carl;
+
+namespace {
+
+std::string make_cache_dir() {
+    llvm::SmallString<128> dir;
+    llvm::sys::fs::createUniqueDirectory("carl-object-cache-test", dir);
+    return std::string(dir);
+}
+
+TEST(ObjectCache, key_depends_on_source_and_flags) {
+    auto key = CarlObjectCache::make_key("return 1;");
+    ASSERT_EQ(key, CarlObjectCache::make_key("return 1;"));
+    ASSERT_NE(key, CarlObjectCache::make_key("return 2;"));
+    ASSERT_NE(key, CarlObjectCache::make_key("return 1;", "gc;"));
+}
+
+TEST(ObjectCache, key_depends_on_codegen_options) {
+    CarlJIT jit;
+    Codegen2 cg;
+    auto key = jit.cache_key("return 1;", cg);
+    ASSERT_EQ(key, jit.cache_key("return 1;", cg));
+
+    cg.set_entry_point(true);
+    auto entry_point_key = jit.cache_key("return 1;", cg);
+    ASSERT_NE(key, entry_point_key);
+
+    cg.set_incremental(true);
+    ASSERT_NE(entry_point_key, jit.cache_key("return 1;", cg));
+}
+
+TEST(ObjectCache, warm_start_skips_codegen) {
+    std::string cache_dir = make_cache_dir();
+    std::string src = ""
+        "fn add(a: int, b: int): int {"
+        "   return a + b;"
+        "}"
+        "return add(40, 2);";
+
+    {
+        CarlJIT jit(CarlJITOptions{.cache_dir = cache_dir});
+        Codegen2 cg;
+        auto key = jit.cache_key(src, cg);
+        ASSERT_FALSE(jit.load_cached(key));
+
+        Parser p;
+        cg.init(key);
+        auto decls = p.parse_r(src, false);
+        auto module = cg.generate(*decls);
+        jit.load_module(module);
+        auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+        ASSERT_EQ(__main(), 42);
+    }
+
+    {
+        CarlJIT jit(CarlJITOptions{.cache_dir = cache_dir});
+        Codegen2 cg;
+        ASSERT_TRUE(jit.load_cached(jit.cache_key(src, cg)));
+        auto __main = jit.lookup_ea("__carl_main")->toPtr<uint64_t()>();
+        ASSERT_EQ(__main(), 42);
+    }
+
+    llvm::sys::fs::remove_directories(cache_dir);
+}
+
+TEST(ObjectCache, not_used_with_lazy_or_tiered) {
+    std::string cache_dir = make_cache_dir();
+    ASSERT_TRUE(CarlJIT(CarlJITOptions{.cache_dir = cache_dir}).has_object_cache());
+    ASSERT_FALSE(CarlJIT(CarlJITOptions{.cache_dir = cache_dir, .lazy = true}).has_object_cache());
+    ASSERT_FALSE(CarlJIT(CarlJITOptions{.cache_dir = cache_dir, .tiered = true}).has_object_cache());
+    llvm::sys::fs::remove_directories(cache_dir);
+}
+
+}  // namespace
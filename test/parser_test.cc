@@ -340,6 +340,92 @@ TEST(Parser, parse_composition_invalid) {
     ASSERT_FALSE(r);
 }
 
+TEST(Parser, parse_partial_application) {
+    Parser parser;
+    std::string src = 
+    "fn add(a: int, b: int) : int { return a + b; }"
+    "fn apply(f: (int : int), a: int) : int { return f(a); }"
+    "let add_two = add(_, 2);"
+    "let result = apply(add(1, _), 3) + add_two(1);";
+
+    ParseResult r = parser.parse_r(src);
+    ASSERT_TRUE(r);
+}
+
+TEST(Parser, parse_partial_application_invalid) {
+    Parser parser;
+    std::string src = 
+    "fn add(a: int, b: int) : int { return a + b; }"
+    "let add_two = add(_, 2);"
+    "let result = add_two(1, 2);";
+
+    ParseResult r = parser.parse_r(src);
+    ASSERT_FALSE(r);
+}
+
+TEST(Parser, parse_arrays) {
+    Parser parser;
+    std::string src = 
+    "fn sum(a: [int]) : int { return a[0] + a[len(a) - 1]; }"
+    "let a = [1, 2, 3];"
+    "let grid = [a; 4];"
+    "grid[1][2] = sum(a);"
+    "let floats = [0.5, 1.5];"
+    "let result = grid[1][2] + len(floats);";
+
+    ParseResult r = parser.parse_r(src);
+    ASSERT_TRUE(r);
+}
+
+TEST(Parser, parse_arrays_invalid) {
+    std::vector<std::string> sources = {
+        "let a = [1, 2.5];",
+        "let a = [];",
+        "let a = [1; 2.0];",
+        "let a = [1, 2]; let b = a[true];",
+        "let a = 1; let b = a[0];",
+        "let a = [1, 2]; a[0] = \"one\";",
+        "let a = len(1);",
+    };
+    for (auto& src : sources) {
+        Parser parser;
+        ParseResult r = parser.parse_r(src);
+        ASSERT_FALSE(r) << src;
+    }
+}
+
+TEST(Parser, parse_array_functions) {
+    Parser parser;
+    std::string src = 
+    "fn double(x: int) : float { return x * 2.0; }"
+    "fn positive(x: float) : bool { return x > 0.0; }"
+    "fn add(a: float, b: float) : float { return a + b; }"
+    "let a = [1, 2, 3];"
+    "let doubled = map(double, a);"
+    "let sum = fold(add, 0.0, filter(positive, doubled)) + doubled[0];"
+    "let total = par_reduce(add, 0.0, par_map(double, a));";
+
+    ParseResult r = parser.parse_r(src);
+    ASSERT_TRUE(r);
+}
+
+TEST(Parser, parse_array_functions_invalid) {
+    std::vector<std::string> sources = {
+        "fn f(x: float) : float { return x; } let a = map(f, [1, 2]);",
+        "fn f(x: int) : int { return x; } let a = filter(f, [1, 2]);",
+        "fn f(a: int, x: int) : float { return 1.0; } let a = fold(f, 0, [1, 2]);",
+        "fn f(x: int) : int { return x; } let a = map([1, 2], f);",
+        "fn f(x: int) : int { return x; } let a = map(f, 1);",
+        "fn f(a: float, x: int) : float { return 1.0; } let a = par_reduce(f, 0.0, [1, 2]);",
+        "fn f(x: int) : int { return x; } let a = par_map(f, [1, 2], [3]);",
+    };
+    for (auto& src : sources) {
+        Parser parser;
+        ParseResult r = parser.parse_r(src);
+        ASSERT_FALSE(r) << src;
+    }
+}
+
 TEST(Parser, parser_fn_with_fn_formal_param) {
     Parser parser;
     std::string src = 
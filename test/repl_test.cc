@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include "carl/jit2/repl.h"
+#include "carl/jit2/runtime_types.h"
+
+using namespace carl;
+
+namespace {
+
+/* Compiles and loads line, returns what its main function returns. */
+template <typename T>
+T run(Repl& repl, const std::string& line) {
+    auto module = repl.compile(line);
+    EXPECT_TRUE(module);
+    std::string main_name = module->get_main_name();
+    EXPECT_TRUE(repl.get_jit().load_module(*module));
+    auto main = repl.get_jit().lookup_ea(main_name.c_str());
+    EXPECT_TRUE(main);
+    return main->toPtr<T()>()();
+}
+
+TEST(repl, lines_use_earlier_definitions) {
+    Repl repl;
+    run<void>(repl, "let x = 40;");
+    run<void>(repl, "fn add(a: int, b: int): int { return a + b; }");
+    ASSERT_EQ(run<uint64_t>(repl, "add(x, 2);"), 42);
+
+    run<void>(repl, "x = x + 1;");
+    ASSERT_EQ(run<uint64_t>(repl, "x;"), 41);
+
+    /* The captures of a closure outlive the line that created it. */
+    run<void>(repl, "let y = 10;");
+    run<void>(repl, "fn add_y(a: int): int { return add(a, y); }");
+    ASSERT_EQ(run<uint64_t>(repl, "add_y(1);"), 11);
+    ASSERT_EQ(run<uint64_t>(repl, "let twice = add_y . add_y; return twice(1);"), 21);
+
+    /* Later lines can assign to the lets a function of the line reads. */
+    run<void>(repl, "let c = 5; fn get_c(): int { return c; }");
+    run<void>(repl, "c = 6;");
+    ASSERT_EQ(run<uint64_t>(repl, "get_c();"), 6);
+
+    run<void>(repl, "let name = \"carl\";");
+    ASSERT_STREQ(run<crt_string*>(repl, "name + \"!\";")->data, "carl!");
+}
+
+TEST(repl, lines_only_declare_what_they_use) {
+    Repl repl;
+    for (int i = 0; i < 50; ++i) {
+        std::string n = std::to_string(i);
+        run<void>(repl, "fn f" + n + "(x: int): int { return x + " + n + "; } let v" + n + " = " + n + ";");
+    }
+
+    auto module = repl.compile("f7(v3);");
+    ASSERT_TRUE(module);
+    size_t num_declarations = 0;
+    module->take_llvm_module().withModuleDo([&](llvm::Module& m) {
+        for (auto& fn : m) num_declarations += fn.isDeclaration();
+        for (auto& global : m.globals()) num_declarations += global.isDeclaration();
+    });
+    /* f7_impl and v3, crt_print_int */
+    ASSERT_LE(num_declarations, 3);
+}
+
+TEST(repl, errors_keep_the_session) {
+    Repl repl;
+    run<void>(repl, "let x = 1;");
+    ASSERT_FALSE(repl.compile("let y = x + \"a\";"));
+    ASSERT_FALSE(repl.compile("let = ;"));
+    ASSERT_FALSE(repl.compile("y;"));
+
+    /* Type checks, fails in codegen, its definitions are gone */
+    run<void>(repl, "fn g(): int { return 1; }");
+    ASSERT_FALSE(repl.compile("let z = 2; fn h(): int { return z; } g = g;"));
+    ASSERT_FALSE(repl.compile("z;"));
+    ASSERT_FALSE(repl.compile("h();"));
+    ASSERT_EQ(run<uint64_t>(repl, "let z = 3; return x + g() + z;"), 5);
+}
+
+}  // namespace
@@ -10,7 +10,7 @@ namespace {
 
 TEST(Scanner, scanSingle) {
     Scanner scanner;
-    auto test = "(){},.-+;/*|||&&&";
+    auto test = "(){}[],.-+;/*|||&&&";
     scanner.init(test);
 
     std::vector<TokenType> tokens;
@@ -21,12 +21,12 @@ TEST(Scanner, scanSingle) {
     } while (t.type != TOKEN_EOF);
 
     std::vector<TokenType> expected = {
-        TOKEN_LEFT_PAREN,  TOKEN_RIGHT_PAREN, TOKEN_LEFT_BRACE,
-        TOKEN_RIGHT_BRACE, TOKEN_COMMA,       TOKEN_DOT,
-        TOKEN_MINUS,       TOKEN_PLUS,        TOKEN_SEMICOLON,
-        TOKEN_SLASH,       TOKEN_STAR,        TOKEN_OR,
-        TOKEN_PIPE,        TOKEN_AND,         TOKEN_ERROR,
-        TOKEN_EOF};
+        TOKEN_LEFT_PAREN,    TOKEN_RIGHT_PAREN, TOKEN_LEFT_BRACE,
+        TOKEN_RIGHT_BRACE,   TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
+        TOKEN_COMMA,         TOKEN_DOT,         TOKEN_MINUS,
+        TOKEN_PLUS,          TOKEN_SEMICOLON,   TOKEN_SLASH,
+        TOKEN_STAR,          TOKEN_OR,          TOKEN_PIPE,
+        TOKEN_AND,           TOKEN_ERROR,       TOKEN_EOF};
 
     ASSERT_EQ(tokens, expected);
 }
@@ -0,0 +1,52 @@
+#include "carl/jit2/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using namespace carl;
+
+namespace {
+
+TEST(ThreadPool, covers_every_index_once) {
+    ThreadPool pool(4);
+    ASSERT_EQ(pool.get_num_threads(), 4);
+    for (uint64_t n : {1, 7, 1000, 12345}) {
+        std::vector<std::atomic<int>> visits(n);
+        pool.parallel_for(n, 16, [&](uint64_t begin, uint64_t end) {
+            ASSERT_LE(end - begin, 16);
+            for (uint64_t i = begin; i < end; ++i) visits[i]++;
+        });
+        for (uint64_t i = 0; i < n; ++i) ASSERT_EQ(visits[i], 1) << i;
+    }
+}
+
+TEST(ThreadPool, idle_threads_steal_work) {
+    ThreadPool pool(4);
+    /* All the work is in the first quarter, the other threads have to take
+     * it from the first one. */
+    pool.parallel_for(4000, 10, [&](uint64_t begin, uint64_t end) {
+        if (begin < 1000) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    });
+    ASSERT_EQ(pool.get_stats().num_jobs, 1);
+    ASSERT_GT(pool.get_stats().num_steals, 0);
+}
+
+TEST(ThreadPool, nested_calls_run_inline) {
+    ThreadPool pool(3);
+    std::atomic<uint64_t> sum = 0;
+    pool.parallel_for(100, 1, [&](uint64_t begin, uint64_t end) {
+        pool.parallel_for(10, 1, [&](uint64_t inner_begin, uint64_t inner_end) {
+            ASSERT_EQ(inner_begin, 0);
+            ASSERT_EQ(inner_end, 10);
+            sum += (end - begin) * 10;
+        });
+    });
+    ASSERT_EQ(sum, 1000);
+    ASSERT_EQ(pool.get_stats().num_jobs, 1);
+}
+
+}  // namespace
@@ -50,9 +50,9 @@ def generate_member_getters(members: list[ClassMember]):
     return "\n".join(ds)
 
 def generate_member_setters(members: list[ClassMember]):
-    non_opt_members = list(filter(lambda m: m.is_optional, members))
+    """ All members, passes like constant folding replace child nodes """
     ds = list()
-    for m in non_opt_members:
+    for m in members:
         d = f"    void set_{m.name}({m.typename} {m.name.lower()}) {{ this->{m.name} = {m.name.lower()};}}"
         ds.append(d)
     return "\n".join(ds)
@@ -26,7 +26,8 @@ TYPES = [
         @ptr<Block> body, 
         @ptr<types::Type> type?=std::make_shared<types::Unknown>(),
         @list<@ptr<Variable>> captures?=std::list<std::shared_ptr<Variable>>(),
-        bool is_extern?=false
+        bool is_extern?=false,
+        bool escapes?=true
     ) : AstNode""",
     """LetDecl(
         Token name,
@@ -46,7 +47,11 @@ TYPES = [
     "Literal(Token value) : Expression",
     "String(Token value) : Expression",
     "Number(Token value) : Expression",
-    "Call(Token fname, @list<@ptr<Expression>> arguments) : Expression",
+    "Call(Token fname, @list<@ptr<Expression>> arguments, bool is_partial?=false) : Expression",
+    "Placeholder(Token token) : Expression",
+    "ArrayLiteral(Token bracket, @list<@ptr<Expression>> elements) : Expression",
+    "ArrayRepeat(Token bracket, @ptr<Expression> value, @ptr<Expression> count) : Expression",
+    "Index(Token bracket, @ptr<Expression> array, @ptr<Expression> index) : Expression",
     "MatchArm(@ptr<Expression> result) : Expression",
     "Match(@ptr<Expression> matchee, @list<@ptr<MatchArm>> arms) : Expression",
 ]